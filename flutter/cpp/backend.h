@@ -60,6 +60,26 @@ class Backend {
   // Returns the result after inferencing.
   virtual std::vector<void*> GetPredictedOutputs(int batchIndex = 0) = 0;
 
+  // Copies at most capacity timestamps of the last query: when it was issued,
+  // then when each output token was produced. Returns the number copied, 0 if
+  // the backend does not record them.
+  virtual int GetTokenTimestamps(int64_t* timestamps_ns, int capacity) {
+    return 0;
+  }
+
+  // Copies the number of draft tokens proposed and accepted by speculative
+  // decoding during the last query. Returns false if the backend does not use
+  // a draft model.
+  virtual bool GetDraftTokenCounts(int64_t* proposed, int64_t* accepted) {
+    return false;
+  }
+
+  // Streams the output tokens of the following queries to callback. Returns
+  // false if the backend does not stream tokens.
+  virtual bool SetTokenCallback(token_callback callback, void* context) {
+    return false;
+  }
+
   // Returns the input format required by the model.
   virtual const DataFormat& GetInputFormat() = 0;
 
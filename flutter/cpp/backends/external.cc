@@ -190,6 +190,18 @@ BackendFunctions::BackendFunctions(const std::string& lib_path) {
   // Backends may need to change the format of the outputs (e.g. channel order)
   convert_outputs = reinterpret_cast<decltype(convert_outputs)>(
       CheckSymbol("mlperf_backend_convert_outputs"));
+  // Backends may use the sample buffers as input tensors to avoid a copy
+  bind_input = reinterpret_cast<decltype(bind_input)>(
+      CheckSymbol("mlperf_backend_bind_input"));
+  // Token based backends may report per-token timestamps
+  get_token_timestamps = reinterpret_cast<decltype(get_token_timestamps)>(
+      CheckSymbol("mlperf_backend_get_token_timestamps"));
+  // Token based backends may stream their output tokens
+  set_token_callback = reinterpret_cast<decltype(set_token_callback)>(
+      CheckSymbol("mlperf_backend_set_token_callback"));
+  // Backends using speculative decoding may report their draft token counts
+  get_draft_token_counts = reinterpret_cast<decltype(get_draft_token_counts)>(
+      CheckSymbol("mlperf_backend_get_draft_token_counts"));
   // If both functions are defined, then update
   if (get_buffer && release_buffer) {
     LOG(INFO) << "Using backend allocator";
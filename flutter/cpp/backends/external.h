@@ -69,6 +69,14 @@ struct BackendFunctions {
                                                  int, uint8_t*)>::type;
   using ConvertOutputsPtr = std::add_pointer<void(mlperf_backend_ptr_t, int,
                                                   int, int, uint8_t*)>::type;
+  using BindInputPtr = std::add_pointer<mlperf_status_t(
+      mlperf_backend_ptr_t, uint32_t, int32_t, void*)>::type;
+  using GetTokenTimestampsPtr = std::add_pointer<int32_t(
+      mlperf_backend_ptr_t, int64_t*, int32_t)>::type;
+  using SetTokenCallbackPtr = std::add_pointer<mlperf_status_t(
+      mlperf_backend_ptr_t, token_callback, void*)>::type;
+  using GetDraftTokenCountsPtr = std::add_pointer<mlperf_status_t(
+      mlperf_backend_ptr_t, int64_t*, int64_t*)>::type;
 
   // Required functions.
   BackendMatchesPtr match{nullptr};
@@ -94,6 +102,10 @@ struct BackendFunctions {
   AllocatorMgr::ReleaseBufferFn release_buffer{nullptr};
   ConvertInputsPtr convert_inputs{nullptr};
   ConvertOutputsPtr convert_outputs{nullptr};
+  BindInputPtr bind_input{nullptr};
+  GetTokenTimestampsPtr get_token_timestamps{nullptr};
+  SetTokenCallbackPtr set_token_callback{nullptr};
+  GetDraftTokenCountsPtr get_draft_token_counts{nullptr};
 
   bool isLoaded() { return isloaded; }
 
@@ -179,6 +191,12 @@ class ExternalBackend : public Backend {
     }
 
     for (int i = 0; i < inputs.size(); ++i) {
+      // Let the backend use the sample buffer directly if it can.
+      if (backend_functions_.bind_input &&
+          backend_functions_.bind_input(backend_ptr_, batchIndex, i,
+                                        inputs[i]) == MLPERF_SUCCESS) {
+        continue;
+      }
       if (backend_functions_.set_input(backend_ptr_, batchIndex, i,
                                        inputs[i]) != MLPERF_SUCCESS) {
         LOG(FATAL) << "Error while setting inputs";
@@ -200,6 +218,28 @@ class ExternalBackend : public Backend {
     return outputs;
   }
 
+  // Copies the token timestamps of the last query, if the backend keeps them.
+  int GetTokenTimestamps(int64_t* timestamps_ns, int capacity) override {
+    if (!backend_functions_.get_token_timestamps) return 0;
+    return backend_functions_.get_token_timestamps(backend_ptr_, timestamps_ns,
+                                                   capacity);
+  }
+
+  // Copies the draft token counts of the last query, if the backend keeps
+  // them.
+  bool GetDraftTokenCounts(int64_t* proposed, int64_t* accepted) override {
+    if (!backend_functions_.get_draft_token_counts) return false;
+    return backend_functions_.get_draft_token_counts(
+               backend_ptr_, proposed, accepted) == MLPERF_SUCCESS;
+  }
+
+  // Streams the output tokens to callback, if the backend supports it.
+  bool SetTokenCallback(token_callback callback, void* context) override {
+    if (!backend_functions_.set_token_callback) return false;
+    return backend_functions_.set_token_callback(backend_ptr_, callback,
+                                                 context) == MLPERF_SUCCESS;
+  }
+
   // Returns the input format required by the model.
   const DataFormat& GetInputFormat() override { return input_format_; }
 
@@ -142,10 +142,12 @@ int Main(int argc, char *argv[]) {
   command_line += " " + backend_name + " " + benchmark_id;
 
   // Command Line Flags for mlperf.
-  std::string mode, scenario = "SingleStream", output_dir, custom_config;
+  std::string mode, scenario = "SingleStream", output_dir, custom_config,
+      sample_cache_dir;
   int min_query_count = 100, min_duration_ms = 100,
       max_duration_ms = 10 * 60 * 1000,
-      single_stream_expected_latency_ns = 1000000;
+      single_stream_expected_latency_ns = 1000000, pipeline_depth = 0,
+      loader_threads = 0;
   flag_list.clear();
   flag_list.insert(
       flag_list.end(),
@@ -169,12 +171,23 @@ int Main(int argc, char *argv[]) {
        Flag::CreateFlag("output_dir", &output_dir,
                         "The output directory of mlperf.", Flag::kRequired),
        Flag::CreateFlag("custom_config", &custom_config,
-                        "Custom config in form key1:val1,key2:val2.")});
+                        "Custom config in form key1:val1,key2:val2."),
+       Flag::CreateFlag("pipeline_depth", &pipeline_depth,
+                        "Number of outputs that can wait for post-processing "
+                        "while the next inference runs. 0 disables it."),
+       Flag::CreateFlag("loader_threads", &loader_threads,
+                        "Number of threads preprocessing images when loading "
+                        "samples. 0 uses one per hardware thread."),
+       Flag::CreateFlag("sample_cache_dir", &sample_cache_dir,
+                        "Directory to cache preprocessed image samples and "
+                        "tokenized prompts in between runs. Empty disables "
+                        "the cache.")});
   // Command Line Flags for backend.
   std::unique_ptr<Backend> backend;
   std::unique_ptr<Dataset> dataset;
 
   int batch_size = 1;
+  float target_qps = 0;
   switch (backend_type) {
     case BackendType::EXTERNAL: {
       LOG(INFO) << "Using External backend";
@@ -191,7 +204,11 @@ int Main(int argc, char *argv[]) {
                "native_lib_path", &native_lib_path,
                "Path to the additional .so files for the backend."),
            Flag::CreateFlag("scenario", &scenario,
-                            "Scenario to run the benchmark."),
+                            "Scenario to run the benchmark. One among "
+                            "SingleStream, Offline, Server, MultiStream."),
+           Flag::CreateFlag("target_qps", &target_qps,
+                            "Target queries per second in the Server "
+                            "scenario."),
            Flag::CreateFlag("batch_size", &batch_size, "Batch size.")});
 
       if (Flags::Parse(&argc, const_cast<const char **>(argv), flag_list)) {
@@ -261,7 +278,8 @@ int Main(int argc, char *argv[]) {
           backend) {
         dataset.reset(new Imagenet(backend.get(), images_directory,
                                    groundtruth_file, offset, image_width,
-                                   image_height));
+                                   image_height, loader_threads,
+                                   sample_cache_dir));
       }
       // Adds to flag_list for showing help.
       flag_list.insert(flag_list.end(), dataset_flags.begin(),
@@ -292,7 +310,8 @@ int Main(int argc, char *argv[]) {
           backend) {
         dataset.reset(new Coco(backend.get(), images_directory,
                                groundtruth_file, offset, num_classes,
-                               image_width, image_height));
+                               image_width, image_height, loader_threads,
+                               sample_cache_dir));
       }
       // Adds to flag_list for showing help.
       flag_list.insert(flag_list.end(), dataset_flags.begin(),
@@ -340,7 +359,7 @@ int Main(int argc, char *argv[]) {
           backend) {
         dataset.reset(new ADE20K(backend.get(), images_directory,
                                  ground_truth_directory, num_classes,
-                                 image_width, image_height));
+                                 image_width, image_height, loader_threads));
       }
       // Adds to flag_list for showing help.
       flag_list.insert(flag_list.end(), dataset_flags.begin(),
@@ -371,7 +390,7 @@ int Main(int argc, char *argv[]) {
           backend) {
         dataset.reset(new SNUSR(backend.get(), images_directory,
                                 ground_truth_directory, num_channels, scale,
-                                image_width, image_height));
+                                image_width, image_height, loader_threads));
       }
       // Adds to flag_list for showing help.
       flag_list.insert(flag_list.end(), dataset_flags.begin(),
@@ -401,6 +420,7 @@ int Main(int argc, char *argv[]) {
     } break;
     case DatasetConfig::MMLU: {
       bool zero_shot = false;
+      bool early_stop = false;
       LOG(INFO) << "TinyMMLU dataset for LLM benchmark";
       std::string input_tfrecord, sp_path = "";
       std::vector<Flag> dataset_flags{
@@ -414,12 +434,18 @@ int Main(int argc, char *argv[]) {
           Flag::CreateFlag(
               "zero-shot", &zero_shot,
               "Use zero-shot prompts instead of the default few-shot."),
+          Flag::CreateFlag(
+              "early-stop", &early_stop,
+              "Stop generating as soon as the answer letter is known. Speeds "
+              "up accuracy runs, but the results are not valid for "
+              "submission."),
       };
 
       if (Flags::Parse(&argc, const_cast<const char **>(argv), dataset_flags) &&
           backend) {
         dataset.reset(new MmluGen(backend.get(), input_tfrecord, sp_path,
-                                  output_dir, zero_shot, Str2TestMode(mode)));
+                                  output_dir, zero_shot, Str2TestMode(mode),
+                                  early_stop, sample_cache_dir));
       }
       // Adds to flag_list for showing help.
       flag_list.insert(flag_list.end(), dataset_flags.begin(),
@@ -440,8 +466,8 @@ int Main(int argc, char *argv[]) {
 
       if (Flags::Parse(&argc, const_cast<const char **>(argv), dataset_flags) &&
           backend) {
-        dataset.reset(
-            new IFEval(backend.get(), input_tfrecord, sp_path, output_dir));
+        dataset.reset(new IFEval(backend.get(), input_tfrecord, sp_path,
+                                 output_dir, sample_cache_dir));
       }
       // Adds to flag_list for showing help.
       flag_list.insert(flag_list.end(), dataset_flags.begin(),
@@ -471,11 +497,11 @@ int Main(int argc, char *argv[]) {
 
   // Running mlperf.
   MlperfDriver driver(std::move(dataset), std::move(backend), scenario,
-                      batch_size);
+                      batch_size, pipeline_depth);
   driver.RunMLPerfTest(mode, min_query_count, min_duration_ms / 1000.0,
                        max_duration_ms / 1000.0,
                        single_stream_expected_latency_ns, output_dir,
-                       (benchmark_id.rfind("llm", 0) == 0));
+                       (benchmark_id.rfind("llm", 0) == 0), target_qps);
   LOG(INFO) << "Accuracy: " << driver.ComputeAccuracyString();
   return 0;
 }
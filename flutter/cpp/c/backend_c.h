@@ -85,6 +85,32 @@ void mlperf_backend_convert_inputs(mlperf_backend_ptr_t backend_ptr, int bytes,
                                    int width, int height, uint8_t* data);
 void mlperf_backend_convert_outputs(mlperf_backend_ptr_t backend_ptr, int bytes,
                                     int width, int height, uint8_t* data);
+// Use data as the storage of the ith input, of batchIndex'th batch, instead of
+// copying it like mlperf_backend_set_input. data is usually a buffer returned
+// by mlperf_backend_get_buffer and stays valid until the input is set or bound
+// again. Return MLPERF_FAILURE if data cannot be bound, in which case the
+// caller falls back to mlperf_backend_set_input.
+mlperf_status_t mlperf_backend_bind_input(mlperf_backend_ptr_t backend_ptr,
+                                          int32_t batchIndex, int32_t i,
+                                          void* data);
+// Token based backends may report when the output tokens of the last query
+// were produced. timestamps_ns[0] is when mlperf_backend_issue_query started
+// and timestamps_ns[i] when the ith output token was produced, in
+// nanoseconds of a monotonic clock. At most capacity values are written.
+// Return the number of values written.
+int32_t mlperf_backend_get_token_timestamps(mlperf_backend_ptr_t backend_ptr,
+                                            int64_t* timestamps_ns,
+                                            int32_t capacity);
+// Backends using speculative decoding may report how many draft tokens they
+// proposed during the last query and how many of them the target model
+// accepted. Return MLPERF_FAILURE if the backend does not use a draft model.
+mlperf_status_t mlperf_backend_get_draft_token_counts(
+    mlperf_backend_ptr_t backend_ptr, int64_t* proposed, int64_t* accepted);
+// Token based backends may stream their output tokens to callback, see
+// token_callback. A nullptr callback stops streaming. Return MLPERF_FAILURE if
+// streaming is not supported.
+mlperf_status_t mlperf_backend_set_token_callback(
+    mlperf_backend_ptr_t backend_ptr, token_callback callback, void* context);
 
 #ifdef __cplusplus
 }
@@ -63,6 +63,12 @@ typedef struct {
 
 typedef void (*ft_callback)(void* context);
 
+// Receives an output token of the query in batch_index as soon as it is
+// produced. Returning false asks the backend to stop generating tokens for
+// that query.
+typedef bool (*token_callback)(void* context, int32_t batch_index,
+                               int32_t token);
+
 #ifdef __cplusplus
 }
 #endif  // __cplusplus
@@ -21,6 +21,7 @@ limitations under the License.
 #include <vector>
 
 #include "flutter/cpp/backend.h"
+#include "flutter/cpp/thread_pool.h"
 #include "flutter/cpp/utils.h"
 #include "loadgen/query_sample_library.h"
 
@@ -76,6 +77,14 @@ class Dataset : public ::mlperf::QuerySampleLibrary {
   virtual std::string ComputeAccuracyString() { return std::string("N/A"); }
 
  protected:
+  // Returns a pool shared by all datasets to shard accuracy computation. Each
+  // shard should write its own partial result and the caller should reduce
+  // them in index order, so the result does not depend on the thread count.
+  static ThreadPool& EvaluationPool() {
+    static ThreadPool pool(0);
+    return pool;
+  }
+
   const DataFormat input_format_;
   const DataFormat output_format_;
   const std::string backend_name_;
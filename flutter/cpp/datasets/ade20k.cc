@@ -32,7 +32,7 @@ namespace mobile {
 
 ADE20K::ADE20K(Backend *backend, const std::string &image_dir,
                const std::string &ground_truth_dir, int num_classes,
-               int image_width, int image_height)
+               int image_width, int image_height, int loader_threads)
     : Dataset(backend),
       num_classes_(num_classes),
       image_width_(image_width),
@@ -65,11 +65,7 @@ ADE20K::ADE20K(Backend *backend, const std::string &image_dir,
   tflite::evaluation::ImagePreprocessingConfigBuilder builder(
       "image_preprocessing", DataType2TfType(input_format_.at(0).type));
   builder.AddDefaultNormalizationStep();
-  preprocessing_stage_.reset(
-      new tflite::evaluation::ImagePreprocessingStage(builder.build()));
-  if (preprocessing_stage_->Init() != kTfLiteOk) {
-    LOG(FATAL) << "Failed to init preprocessing stage";
-  }
+  image_loader_.reset(new ImageLoader(builder.build(), loader_threads));
 
   // Always use uint8_t for ground truth image
   tflite::evaluation::ImagePreprocessingConfigBuilder gt_builder("ground_truth",
@@ -89,32 +85,9 @@ ADE20K::ADE20K(Backend *backend, const std::string &image_dir,
 }
 
 void ADE20K::LoadSamplesToRam(const std::vector<QuerySampleIndex> &samples) {
-  for (QuerySampleIndex sample_idx : samples) {
-    // Preprocessing.
-    if (sample_idx >= image_list_.size()) {
-      LOG(FATAL) << "Sample index out of bound";
-    }
-    std::string filename = image_list_.at(sample_idx);
-    preprocessing_stage_->SetImagePath(&filename);
-    if (preprocessing_stage_->Run() != kTfLiteOk) {
-      LOG(FATAL) << "Failed to run preprocessing stage";
-    }
-
-    // Move data out of preprocessing_stage_ so it can be reused.
-    int total_byte = input_format_[0].size * GetByte(input_format_[0]);
-    void *data_void = preprocessing_stage_->GetPreprocessedImageData();
-    std::vector<uint8_t, BackendAllocator<uint8_t>> *data_uint8 =
-        new std::vector<uint8_t, BackendAllocator<uint8_t>>(total_byte);
-    std::copy(static_cast<uint8_t *>(data_void),
-              static_cast<uint8_t *>(data_void) + total_byte,
-              data_uint8->begin());
-
-    // Allow backend to convert data layout if needed
-    backend_->ConvertInputs(total_byte, image_width_, image_height_,
-                            data_uint8->data());
-
-    samples_.at(sample_idx).push_back(data_uint8);
-  }
+  int total_byte = input_format_[0].size * GetByte(input_format_[0]);
+  image_loader_->LoadSamples(samples, image_list_, total_byte, image_width_,
+                             image_height_, backend_, &samples_);
 }
 
 void ADE20K::UnloadSamplesFromRam(
@@ -150,7 +123,9 @@ std::vector<uint8_t> ADE20K::ProcessOutput(const int sample_idx,
     bool isOutputFloat = (output_format_.at(0).type == DataType::Float32);
     bool isOutputUint8 = (output_format_.at(0).type == DataType::Uint8);
 
-    for (int c = 1; c <= num_classes_; c++) {
+    // Classes are independent, so each one is counted by a separate task.
+    EvaluationPool().ParallelFor(num_classes_, [&](size_t class_idx, int) {
+      const int c = static_cast<int>(class_idx) + 1;
       uint64_t true_positive = 0, false_positive = 0, false_negative = 0;
 
       for (int i = 0; i < (image_width_ * image_height_); i++) {
@@ -182,7 +157,7 @@ std::vector<uint8_t> ADE20K::ProcessOutput(const int sample_idx,
       tp_acc_[c - 1] += true_positive;
       fp_acc_[c - 1] += false_positive;
       fn_acc_[c - 1] += false_negative;
-    }
+    });
 
 #if __DEBUG__
     for (int j = 0; j < num_classes_; j++) {
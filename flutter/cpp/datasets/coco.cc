@@ -38,7 +38,8 @@ namespace mlperf {
 namespace mobile {
 Coco::Coco(Backend *backend, const std::string &image_dir,
            const std::string &grouth_truth_file, int offset, int num_classes,
-           int image_width, int image_height)
+           int image_width, int image_height, int loader_threads,
+           const std::string &cache_dir)
     : Dataset(backend),
       groundtruth_file_(grouth_truth_file),
       offset_(offset),
@@ -73,39 +74,48 @@ Coco::Coco(Backend *backend, const std::string &image_dir,
       "image_preprocessing", DataType2TfType(input_format_.at(0).type));
   builder.AddResizingStep(image_width, image_height, false);
   builder.AddDefaultNormalizationStep();
-  preprocessing_stage_.reset(
-      new tflite::evaluation::ImagePreprocessingStage(builder.build()));
-  if (preprocessing_stage_->Init() != kTfLiteOk) {
-    LOG(FATAL) << "Failed to init preprocessing stage";
+  image_loader_.reset(new ImageLoader(builder.build(), loader_threads));
+  if (!cache_dir.empty()) {
+    // The key covers everything that changes the converted input tensor,
+    // including the contents of the images as far as their size and
+    // modification time tell.
+    std::stringstream key;
+    key << name_ << "|" << image_dir << "|"
+        << SampleCache::FilesFingerprint(image_list_) << "|"
+        << static_cast<int>(input_format_[0].type) << "|" << image_width << "x"
+        << image_height << "|" << backend_->Name() << "|"
+        << backend_->AcceleratorName();
+    cache_ = SampleCache::Open(
+        cache_dir, key.str(), image_list_.size(),
+        input_format_[0].size * GetByte(input_format_[0]));
   }
 }
 
 void Coco::LoadSamplesToRam(const std::vector<QuerySampleIndex> &samples) {
+  int total_byte = input_format_[0].size * GetByte(input_format_[0]);
+  if (!cache_) {
+    image_loader_->LoadSamples(samples, image_list_, total_byte, image_width_,
+                               image_height_, backend_, &samples_);
+    return;
+  }
+  // Only samples missing from the cache are preprocessed. Cached samples are
+  // copied into buffers of the backend like freshly loaded ones.
+  std::vector<QuerySampleIndex> missing;
   for (QuerySampleIndex sample_idx : samples) {
-    // Preprocessing.
-    if (sample_idx >= image_list_.size()) {
-      LOG(FATAL) << "Sample index out of bound";
+    if (!cache_->Contains(sample_idx)) {
+      missing.push_back(sample_idx);
+      continue;
     }
-    std::string filename = image_list_.at(sample_idx);
-    preprocessing_stage_->SetImagePath(&filename);
-    if (preprocessing_stage_->Run() != kTfLiteOk) {
-      LOG(FATAL) << "Failed to run preprocessing stage";
-    }
-
-    // Move data out of preprocessing_stage_ so it can be reused.
-    int total_byte = input_format_[0].size * GetByte(input_format_[0]);
-    void *data_void = preprocessing_stage_->GetPreprocessedImageData();
-    std::vector<uint8_t, BackendAllocator<uint8_t>> *data_uint8 =
+    std::vector<uint8_t, BackendAllocator<uint8_t>> *v =
         new std::vector<uint8_t, BackendAllocator<uint8_t>>(total_byte);
-    std::copy(static_cast<uint8_t *>(data_void),
-              static_cast<uint8_t *>(data_void) + total_byte,
-              data_uint8->begin());
-
-    // Allow backend to convert data layout if needed
-    backend_->ConvertInputs(total_byte, image_width_, image_height_,
-                            data_uint8->data());
-
-    samples_.at(sample_idx).push_back(data_uint8);
+    cache_->Load(sample_idx, v->data());
+    samples_.at(sample_idx).push_back(v);
+  }
+  if (missing.empty()) return;
+  image_loader_->LoadSamples(missing, image_list_, total_byte, image_width_,
+                             image_height_, backend_, &samples_);
+  for (QuerySampleIndex sample_idx : missing) {
+    cache_->Store(sample_idx, samples_.at(sample_idx).at(0)->data());
   }
 }
 
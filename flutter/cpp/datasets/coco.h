@@ -25,6 +25,8 @@ limitations under the License.
 #include "absl/container/flat_hash_map.h"
 #include "allocator.h"
 #include "flutter/cpp/dataset.h"
+#include "flutter/cpp/datasets/image_loader.h"
+#include "flutter/cpp/datasets/sample_cache.h"
 #include "flutter/cpp/datasets/utils.h"
 #include "tensorflow/lite/tools/evaluation/proto/evaluation_stages.pb.h"
 #include "tensorflow/lite/tools/evaluation/stages/image_preprocessing_stage.h"
@@ -38,10 +40,13 @@ class Coco : public Dataset {
   // Coco assumes that there is a single input resevered for the image data
   // and 4 outputs which are bboxes, label indexes, probabilities, number of
   // detections respectively. In a bbox, the order of the data is xmin, ymin,
-  // xmax, ymax.
+  // xmax, ymax. loader_threads is the number of threads preprocessing images,
+  // 0 uses one per hardware thread. If cache_dir is not empty, preprocessed
+  // samples are cached there and reused by later runs.
   Coco(Backend* backend, const std::string& image_dir,
        const std::string& grouth_truth_file, int offset, int num_classes,
-       int image_width, int image_height);
+       int image_width, int image_height, int loader_threads = 0,
+       const std::string& cache_dir = "");
 
   // Returns the name of the dataset.
   const std::string& Name() override { return name_; }
@@ -97,9 +102,10 @@ class Coco : public Dataset {
   // Groundtruth and predicted results.
   absl::flat_hash_map<std::string, tflite::evaluation::ObjectDetectionResult>
       predicted_objects_;
-  // preprocessing_stage_ conducts preprocessing of images.
-  std::unique_ptr<tflite::evaluation::ImagePreprocessingStage>
-      preprocessing_stage_;
+  // image_loader_ conducts preprocessing of images.
+  std::unique_ptr<ImageLoader> image_loader_;
+  // Preprocessed samples kept on disk between runs. Null if disabled.
+  std::unique_ptr<SampleCache> cache_;
 
   // The width and height of the input images.
   int image_width_, image_height_;
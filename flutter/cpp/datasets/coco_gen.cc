@@ -68,9 +68,8 @@ CocoGen::CocoGen(Backend* backend, const std::string& input_tfrecord,
 
 void CocoGen::LoadSamplesToRam(const std::vector<QuerySampleIndex>& samples) {
   for (QuerySampleIndex sample_idx : samples) {
-    tensorflow::tstring record = sample_reader_.ReadRecord(sample_idx);
-    samples_.at(sample_idx) =
-        std::move(std::make_unique<CaptionRecord>(CaptionRecord(record)));
+    std::string_view record = sample_reader_.ReadRecord(sample_idx);
+    samples_.at(sample_idx) = std::make_unique<CaptionRecord>(record);
   }
 }
 
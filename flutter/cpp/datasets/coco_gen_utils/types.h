@@ -15,6 +15,8 @@ limitations under the License.
 #ifndef MLPERF_DATASETS_COCO_GEN_UTILS_TYPES_H_
 #define MLPERF_DATASETS_COCO_GEN_UTILS_TYPES_H_
 
+#include <string_view>
+
 #include "tensorflow/core/example/example.pb.h"
 #include "tensorflow/core/example/feature_util.h"
 #include "tensorflow/core/platform/types.h"
@@ -24,10 +26,10 @@ namespace mobile {
 
 // CaptionRecord is equivalent to records in the ground truth tfrecord file.
 struct CaptionRecord {
-  explicit CaptionRecord(const tensorflow::tstring& record) {
+  explicit CaptionRecord(std::string_view record) {
     using string = std::string;
     tensorflow::Example example;
-    example.ParseFromString(record);
+    example.ParseFromArray(record.data(), record.size());
 
     auto caption_id_list =
         tensorflow::GetFeatureValues<int64_t>("caption_id", example);
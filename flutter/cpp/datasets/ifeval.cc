@@ -4,6 +4,7 @@
 #include <fstream>
 
 #include "flutter/cpp/datasets/mmlu_utils/sentencepiece_utils.h"
+#include "flutter/cpp/datasets/token_cache.h"
 #include "tensorflow/core/example/example.pb.h"
 #include "tensorflow/core/example/feature_util.h"
 
@@ -11,7 +12,8 @@ namespace mlperf {
 namespace mobile {
 
 IFEval::IFEval(Backend* backend, const std::string& input_tfrecord,
-               const std::string& sp_path, const std::string& output_dir)
+               const std::string& sp_path, const std::string& output_dir,
+               const std::string& cache_dir)
     : sample_reader_(input_tfrecord), Dataset(backend) {
   sp_processor = std::unique_ptr<sentencepiece::SentencePieceProcessor>(
       LoadSentencePieceProcessor(sp_path));
@@ -28,31 +30,49 @@ IFEval::IFEval(Backend* backend, const std::string& input_tfrecord,
   // Load all TFRecord samples into memory
   // NOTE this can be moved to LoadSamplesToRam, but will cause delays between
   // queries due to IO reads
-  for (size_t i = 0; i < sample_reader_.Size(); i++) {
-    tensorflow::tstring record = sample_reader_.ReadRecord(i);
-    tensorflow::Example example;
-    example.ParseFromString(record);
-    int key = tensorflow::GetFeatureValues<int64_t>("key", example).Get(0);
-    std::string prompt =
-        tensorflow::GetFeatureValues<std::string>("prompt", example).Get(0);
-    auto instructions = BuildInstructions(example);
-
-    std::string input_formatted = FormatLlamaUserPrompt(prompt);
-    std::vector<int> input_tokens;
-    sp_processor->Encode(input_formatted.c_str(), &input_tokens).ok();
+  size_t num_records = sample_reader_.Size();
+  std::vector<tensorflow::Example> examples(num_records);
+  std::vector<std::string> prompts(num_records);
+  for (size_t i = 0; i < num_records; i++) {
+    std::string_view record = sample_reader_.ReadRecord(i);
+    examples[i].ParseFromArray(record.data(), record.size());
+    prompts[i] =
+        tensorflow::GetFeatureValues<std::string>("prompt", examples[i]).Get(0);
+  }
+
+  // Tokenize the prompts in parallel, unless a previous run cached the tokens.
+  std::vector<std::vector<int>> input_tokens;
+  std::vector<int32_t> unused_metadata;
+  std::unique_ptr<TokenCache> token_cache;
+  if (!cache_dir.empty()) {
+    token_cache =
+        std::make_unique<TokenCache>(cache_dir, input_tfrecord, sp_path, name_);
+  }
+  if (!token_cache || !token_cache->Load(&input_tokens, &unused_metadata) ||
+      input_tokens.size() != num_records) {
+    input_tokens.assign(num_records, {});
+    unused_metadata.assign(num_records, 0);
+    EvaluationPool().ParallelFor(num_records, [&](size_t i, int) {
+      std::string input_formatted = FormatLlamaUserPrompt(prompts[i]);
+      sp_processor->Encode(input_formatted.c_str(), &input_tokens[i]).ok();
+    });
+    if (token_cache) token_cache->Save(input_tokens, unused_metadata);
+  }
 
+  for (size_t i = 0; i < num_records; i++) {
     // input token sanity check
-    if (input_tokens.size() > input_token_limit_) {
+    if (input_tokens[i].size() > input_token_limit_) {
       LOG(WARNING) << "Input token limit exceeded for entry "
                    << std::to_string(i) << ". Ignoring.";
       continue;
     }
 
     auto sample = std::make_unique<ifeval::Sample>();
-    sample->key = key;
-    sample->prompt = prompt;
-    sample->input_tokens = input_tokens;
-    sample->instructions = std::move(instructions);
+    sample->key =
+        tensorflow::GetFeatureValues<int64_t>("key", examples[i]).Get(0);
+    sample->prompt = std::move(prompts[i]);
+    sample->input_tokens = std::move(input_tokens[i]);
+    sample->instructions = BuildInstructions(examples[i]);
 
     samples_.push_back(std::move(sample));
     sample_output_tokens_.push_back(std::vector<int>());
@@ -154,8 +174,21 @@ float IFEval::ComputeAccuracy() {
   float prompt_strict_accuracy;
   ifeval::Accuracy accuracy;
 
-  for (auto sample_id : used_sample_ids_) {
-    ComputeSampleAccuracy(sample_id, accuracy);
+  // Samples are checked in parallel, each into its own counters, and the
+  // counters are added up afterwards.
+  std::vector<size_t> sample_ids(used_sample_ids_.begin(),
+                                 used_sample_ids_.end());
+  std::vector<ifeval::Accuracy> sample_accuracy(sample_ids.size());
+  EvaluationPool().ParallelFor(sample_ids.size(), [&](size_t i, int) {
+    ComputeSampleAccuracy(sample_ids[i], sample_accuracy[i]);
+  });
+  for (const ifeval::Accuracy& a : sample_accuracy) {
+    accuracy.prompt_correct_loose += a.prompt_correct_loose;
+    accuracy.prompt_correct_strict += a.prompt_correct_strict;
+    accuracy.prompt_total += a.prompt_total;
+    accuracy.instruction_correct_loose += a.instruction_correct_loose;
+    accuracy.instruction_correct_strict += a.instruction_correct_strict;
+    accuracy.instruction_total += a.instruction_total;
   }
 
   instruction_loose_accuracy =
@@ -40,7 +40,8 @@ struct Accuracy {
 class IFEval : public Dataset {
  public:
   IFEval(Backend* backend, const std::string& input_tfrecord,
-         const std::string& sp_path, const std::string& output_dir);
+         const std::string& sp_path, const std::string& output_dir,
+         const std::string& cache_dir = "");
 
   const std::string& Name() override { return name_; }
 
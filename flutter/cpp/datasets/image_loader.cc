@@ -0,0 +1,74 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "flutter/cpp/datasets/image_loader.h"
+
+#include <algorithm>
+
+#include "tensorflow/core/platform/logging.h"
+
+namespace mlperf {
+namespace mobile {
+
+ImageLoader::ImageLoader(
+    const tflite::evaluation::EvaluationStageConfig& config, int num_threads)
+    : pool_(num_threads) {
+  for (int i = 0; i < pool_.NumThreads(); ++i) {
+    stages_.emplace_back(
+        new tflite::evaluation::ImagePreprocessingStage(config));
+    if (stages_.back()->Init() != kTfLiteOk) {
+      LOG(FATAL) << "Failed to init preprocessing stage";
+    }
+  }
+}
+
+void ImageLoader::LoadSamples(
+    const std::vector<::mlperf::QuerySampleIndex>& samples,
+    const std::vector<std::string>& image_list, size_t total_byte,
+    int image_width, int image_height, Backend* backend,
+    std::vector<std::vector<SampleBuffer*>>* loaded) {
+  for (::mlperf::QuerySampleIndex sample_idx : samples) {
+    if (sample_idx >= image_list.size()) {
+      LOG(FATAL) << "Sample index out of bound";
+    }
+  }
+
+  pool_.ParallelFor(samples.size(), [&](size_t i, int thread_id) {
+    tflite::evaluation::ImagePreprocessingStage* stage =
+        stages_[thread_id].get();
+    std::string filename = image_list.at(samples[i]);
+    stage->SetImagePath(&filename);
+    if (stage->Run() != kTfLiteOk) {
+      LOG(FATAL) << "Failed to run preprocessing stage";
+    }
+
+    SampleBuffer* data_uint8;
+    {
+      std::lock_guard<std::mutex> lock(backend_mutex_);
+      data_uint8 = new SampleBuffer(total_byte);
+    }
+    // Move data out of the stage so it can be reused.
+    uint8_t* data = static_cast<uint8_t*>(stage->GetPreprocessedImageData());
+    std::copy(data, data + total_byte, data_uint8->begin());
+
+    // Allow backend to convert data layout if needed
+    std::lock_guard<std::mutex> lock(backend_mutex_);
+    backend->ConvertInputs(total_byte, image_width, image_height,
+                           data_uint8->data());
+    (*loaded)[samples[i]].push_back(data_uint8);
+  });
+}
+
+}  // namespace mobile
+}  // namespace mlperf
@@ -0,0 +1,68 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef MLPERF_DATASETS_IMAGE_LOADER_H_
+#define MLPERF_DATASETS_IMAGE_LOADER_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "flutter/cpp/backend.h"
+#include "flutter/cpp/datasets/allocator.h"
+#include "flutter/cpp/thread_pool.h"
+#include "loadgen/query_sample_library.h"
+#include "tensorflow/lite/tools/evaluation/proto/evaluation_config.pb.h"
+#include "tensorflow/lite/tools/evaluation/stages/image_preprocessing_stage.h"
+
+namespace mlperf {
+namespace mobile {
+
+// Preprocessed input of a sample, allocated by the backend.
+using SampleBuffer = std::vector<uint8_t, BackendAllocator<uint8_t>>;
+
+// ImageLoader preprocesses images on a thread pool. Every worker owns an
+// ImagePreprocessingStage built from the same config, so decoding, resizing
+// and normalization of different images run in parallel.
+class ImageLoader {
+ public:
+  // A non-positive num_threads uses one worker per hardware thread.
+  ImageLoader(const tflite::evaluation::EvaluationStageConfig& config,
+              int num_threads);
+
+  // Preprocesses image_list[idx] for every idx in samples. The result is
+  // copied into a backend allocated buffer of total_byte bytes, converted by
+  // the backend, and appended to (*loaded)[idx].
+  void LoadSamples(const std::vector<::mlperf::QuerySampleIndex>& samples,
+                   const std::vector<std::string>& image_list,
+                   size_t total_byte, int image_width, int image_height,
+                   Backend* backend,
+                   std::vector<std::vector<SampleBuffer*>>* loaded);
+
+ private:
+  ThreadPool pool_;
+  // One preprocessing stage per worker thread.
+  std::vector<std::unique_ptr<tflite::evaluation::ImagePreprocessingStage>>
+      stages_;
+  // Backends are not required to be thread-safe, so buffer allocation and
+  // ConvertInputs are serialized.
+  std::mutex backend_mutex_;
+};
+
+}  // namespace mobile
+}  // namespace mlperf
+
+#endif  // MLPERF_DATASETS_IMAGE_LOADER_H_
@@ -22,6 +22,8 @@ limitations under the License.
 
 #include "allocator.h"
 #include "flutter/cpp/dataset.h"
+#include "flutter/cpp/datasets/image_loader.h"
+#include "flutter/cpp/datasets/sample_cache.h"
 #include "flutter/cpp/datasets/utils.h"
 #include "tensorflow/lite/tools/evaluation/stages/image_preprocessing_stage.h"
 
@@ -34,10 +36,13 @@ class Imagenet : public Dataset {
   // Imagenet assumes that there is a single input resevered for the image data
   // and single output which contains the probabilities of every classes. The
   // order of images under image_dir should be the same as the original
-  // LSVRC2012 dataset.
+  // LSVRC2012 dataset. loader_threads is the number of threads preprocessing
+  // images, 0 uses one per hardware thread. If cache_dir is not empty,
+  // preprocessed samples are cached there and reused by later runs.
   Imagenet(Backend* backend, const std::string& image_dir,
            const std::string& groundtruth_file, int offset, int image_width,
-           int image_height);
+           int image_height, int loader_threads = 0,
+           const std::string& cache_dir = "");
 
   // Returns the name of the dataset.
   const std::string& Name() override { return name_; }
@@ -90,9 +95,10 @@ class Imagenet : public Dataset {
       samples_;
   // Predictions from sample_idex to class_index (offset is subtracted).
   std::unordered_map<int32_t, int32_t> predictions_;
-  // preprocessing_stage_ conducts preprocessing of images.
-  std::unique_ptr<tflite::evaluation::ImagePreprocessingStage>
-      preprocessing_stage_;
+  // image_loader_ conducts preprocessing of images.
+  std::unique_ptr<ImageLoader> image_loader_;
+  // Preprocessed samples kept on disk between runs. Null if disabled.
+  std::unique_ptr<SampleCache> cache_;
 
   // The width and height of the input images.
   int image_width_, image_height_;
@@ -4,15 +4,74 @@
 #include <fstream>
 
 #include "flutter/cpp/datasets/mmlu_utils/sentencepiece_utils.h"
+#include "flutter/cpp/datasets/token_cache.h"
 #include "tensorflow/core/example/example.pb.h"
 #include "tensorflow/core/example/feature_util.h"
 
 namespace mlperf {
 namespace mobile {
+namespace {
+
+// Inputs start with a preface, followed by the shots and the question, all
+// separated by empty lines.
+int CountShots(const std::string& input) {
+  size_t position = input.find("\n\n");
+  if (position == std::string::npos) return 0;
+  int count = 0;
+  while ((position = input.find("\n\n", position + 2)) != std::string::npos) {
+    ++count;
+  }
+  return count;
+}
+
+// Returns input without its first count shots.
+std::string DropShots(const std::string& input, int count) {
+  size_t preface_end = input.find("\n\n");
+  if (count <= 0 || preface_end == std::string::npos) return input;
+  preface_end += 2;
+  size_t start = preface_end;
+  for (int i = 0; i < count; ++i) start = input.find("\n\n", start) + 2;
+  return input.substr(0, preface_end) + input.substr(start);
+}
+
+// Tokenizes input, dropping the fewest leading shots needed to fit in limit
+// tokens. Returns the number of dropped shots.
+int EncodeWithinLimit(const sentencepiece::SentencePieceProcessor& processor,
+                      const std::string& input, size_t limit,
+                      std::vector<int>* tokens) {
+  processor.Encode(input.c_str(), tokens).ok();
+  if (tokens->size() <= limit) return 0;
+
+  // The token count only shrinks as shots are dropped, so binary search for
+  // the fewest dropped shots that fit.
+  int low = 1, high = CountShots(input);
+  int dropped = high;
+  std::vector<int> fitting, candidate;
+  while (low <= high) {
+    int middle = low + (high - low) / 2;
+    processor.Encode(DropShots(input, middle).c_str(), &candidate).ok();
+    if (candidate.size() <= limit) {
+      dropped = middle;
+      fitting.swap(candidate);
+      high = middle - 1;
+    } else {
+      low = middle + 1;
+    }
+  }
+  if (fitting.empty()) {
+    processor.Encode(DropShots(input, dropped).c_str(), tokens).ok();
+  } else {
+    tokens->swap(fitting);
+  }
+  return dropped;
+}
+
+}  // namespace
 
 MmluGen::MmluGen(Backend* backend, const std::string& input_tfrecord,
                  const std::string& sp_path, const std::string& output_dir,
-                 bool zero_shot, ::mlperf::TestMode mode)
+                 bool zero_shot, ::mlperf::TestMode mode, bool early_stop,
+                 const std::string& cache_dir)
     : sample_reader_(input_tfrecord), Dataset(backend) {
   sp_processor = std::unique_ptr<sentencepiece::SentencePieceProcessor>(
       LoadSentencePieceProcessor(sp_path));
@@ -26,21 +85,24 @@ MmluGen::MmluGen(Backend* backend, const std::string& input_tfrecord,
     return;
   }
 
+  // Set output token limit to 128 if performance mode is being used
+  if (mode == ::mlperf::TestMode::PerformanceOnly) token_limit_ = 128;
+
   // Load all TFRecord samples into memory
   // NOTE this can be moved to LoadSamplesToRam, but will cause delays between
   // queries due to IO reads happening between them
-  for (size_t i = 0; i < sample_reader_.Size(); i++) {
-    tensorflow::tstring record = sample_reader_.ReadRecord(i);
+  size_t num_samples = sample_reader_.Size();
+  std::vector<std::string> inputs(num_samples);
+  std::vector<std::string> answers(num_samples);
+  for (size_t i = 0; i < num_samples; i++) {
+    std::string_view record = sample_reader_.ReadRecord(i);
     tensorflow::Example example;
-    example.ParseFromString(record);
+    example.ParseFromArray(record.data(), record.size());
     std::string input =
         tensorflow::GetFeatureValues<std::string>("input", example).Get(0);
-    std::string answer =
+    answers[i] =
         tensorflow::GetFeatureValues<std::string>("answer", example).Get(0);
 
-    // Set output token limit to 128 if performance mode is being used
-    if (mode == ::mlperf::TestMode::PerformanceOnly) token_limit_ = 128;
-
     if (zero_shot) {
       // input-formatted shots are separated by 2 new lines, so we find the last
       // one which is the actual question
@@ -54,32 +116,61 @@ MmluGen::MmluGen(Backend* backend, const std::string& input_tfrecord,
 
     // std::string input_formatted = FormatLlamaUserPrompt(input, "Provide only
     // the answer letter, do not provide any explanation or preface.");
+    inputs[i] = std::move(input);
+  }
 
-    std::vector<int> input_tokens;
-    sp_processor->Encode(input.c_str(), &input_tokens).ok();
+  // Tokenize the inputs in parallel, unless a previous run cached the tokens.
+  // The cached metadata is the number of shots dropped from each input.
+  std::vector<std::vector<int>> input_tokens;
+  std::vector<int32_t> dropped_shots;
+  std::unique_ptr<TokenCache> token_cache;
+  if (!cache_dir.empty()) {
+    token_cache = std::make_unique<TokenCache>(
+        cache_dir, input_tfrecord, sp_path,
+        name_ + "|" + std::to_string(zero_shot) + "|" +
+            std::to_string(input_token_limit_));
+  }
+  if (!token_cache || !token_cache->Load(&input_tokens, &dropped_shots) ||
+      input_tokens.size() != num_samples) {
+    input_tokens.assign(num_samples, {});
+    dropped_shots.assign(num_samples, 0);
+    EvaluationPool().ParallelFor(num_samples, [&](size_t i, int) {
+      dropped_shots[i] =
+          EncodeWithinLimit(*sp_processor, inputs[i], input_token_limit_,
+                            &input_tokens[i]);
+    });
+    if (token_cache) token_cache->Save(input_tokens, dropped_shots);
+  }
 
+  for (size_t i = 0; i < num_samples; i++) {
     // input token sanity check
-    while (input_tokens.size() > input_token_limit_) {
-      size_t cur = input.find("\n\n") + 2;
-      std::string preface = input.substr(0, cur);
-      std::string truncated_shots = input.substr(input.find("\n\n", cur) + 2);
-
-      input = preface + truncated_shots;
-
-      sp_processor->Encode(input.c_str(), &input_tokens).ok();
+    if (dropped_shots[i] > 0) {
       LOG(WARNING) << "Input token limit exceeded for entry "
-                   << std::to_string(i) << ". Truncated to "
-                   << input_tokens.size();
+                   << std::to_string(i) << ". Dropped " << dropped_shots[i]
+                   << " shots, truncated to " << input_tokens[i].size();
     }
 
     auto sample = std::make_unique<PromptSample>();
-    sample->input = input;
-    sample->input_tokens = input_tokens;
-    sample->answer = answer;
+    sample->input = DropShots(inputs[i], dropped_shots[i]);
+    sample->input_tokens = std::move(input_tokens[i]);
+    sample->answer = std::move(answers[i]);
 
     samples_.push_back(std::move(sample));
     sample_output_tokens_.push_back(std::vector<int>());
   }
+
+  if (early_stop) {
+    if (mode == ::mlperf::TestMode::PerformanceOnly) {
+      LOG(WARNING) << "MMLU early stop is ignored in performance mode";
+    } else if (!backend_->SetTokenCallback(&MmluGen::OnToken, this)) {
+      LOG(WARNING) << "MMLU early stop is not supported by the backend";
+    } else {
+      LOG(WARNING) << "MMLU early stop is enabled, the results are NOT valid "
+                      "for submission";
+      early_stop_ = true;
+      streamed_predictions_.resize(samples_.size());
+    }
+  }
 }
 
 void MmluGen::LoadSamplesToRam(const std::vector<QuerySampleIndex>& samples) {
@@ -99,6 +190,13 @@ std::vector<void*> MmluGen::GetData(int sample_idx) {
   std::vector<void*> data;
 
   if (sample_idx < samples_.size()) {
+    if (early_stop_) {
+      // The first sample after the outputs were processed starts a new batch.
+      if (streams_done_) streams_.clear();
+      streams_done_ = false;
+      streams_.push_back(
+          {sample_idx, StreamingDetokenizer(sp_processor.get())});
+    }
     data.push_back(reinterpret_cast<void*>(
         const_cast<std::vector<int>*>(&(samples_[sample_idx]->input_tokens))));
     data.push_back(reinterpret_cast<void*>(const_cast<int*>(&token_limit_)));
@@ -115,6 +213,7 @@ std::vector<uint8_t> MmluGen::ProcessOutput(const int sample_idx,
 
   sample_output_tokens_[sample_idx] = output_tokens;
   used_sample_ids_.insert(sample_idx);
+  streams_done_ = true;
 
   return {1};
 }
@@ -127,7 +226,11 @@ bool MmluGen::HasAccuracy() { return true; }
 
 bool MmluGen::ComputeSampleAccuracy(const int sample_idx) {
   std::string prediction;
-  sp_processor->Decode(sample_output_tokens_[sample_idx], &prediction).ok();
+  if (early_stop_ && !streamed_predictions_[sample_idx].empty()) {
+    prediction = streamed_predictions_[sample_idx];
+  } else {
+    sp_processor->Decode(sample_output_tokens_[sample_idx], &prediction).ok();
+  }
 
   char predicted_char = find_answer_char(prediction);
   const std::string& correct = samples_[sample_idx]->answer;
@@ -166,7 +269,20 @@ std::string MmluGen::ComputeAccuracyString() {
   return stream.str();
 }
 
-char MmluGen::find_answer_char(const std::string& input) {
+bool MmluGen::OnToken(void* context, int32_t batch_index, int32_t token) {
+  MmluGen* dataset = reinterpret_cast<MmluGen*>(context);
+  if (batch_index < 0 ||
+      static_cast<size_t>(batch_index) >= dataset->streams_.size()) {
+    return true;
+  }
+  OutputStream& stream = dataset->streams_[batch_index];
+  const std::string& text = stream.detokenizer.Add(token);
+  if (dataset->find_answer_char(text, /*complete=*/false) == 0) return true;
+  dataset->streamed_predictions_[stream.sample_idx] = text;
+  return false;
+}
+
+char MmluGen::find_answer_char(const std::string& input, bool complete) {
   const unsigned char* c =
       reinterpret_cast<const unsigned char*>(input.c_str());
 
@@ -179,6 +295,7 @@ char MmluGen::find_answer_char(const std::string& input) {
 
     // quick check: is the word exactly 1 char long?
     ++c;  // move to potential second char
+    if (!*c && !complete) break;
     if (!*c || std::isspace(*c) || *c == '<') {
       if (*start == 'A' || *start == 'B' || *start == 'C' || *start == 'D' ||
           *start == 'a' || *start == 'b' || *start == 'c' || *start == 'd')
@@ -11,6 +11,7 @@
 #include <vector>
 
 #include "flutter/cpp/dataset.h"
+#include "flutter/cpp/datasets/mmlu_utils/sentencepiece_utils.h"
 #include "flutter/cpp/datasets/squad_utils/tfrecord_reader.h"
 #include "loadgen/test_settings.h"
 #include "src/sentencepiece_processor.h"
@@ -22,7 +23,8 @@ class MmluGen : public Dataset {
  public:
   MmluGen(Backend* backend, const std::string& input_tfrecord,
           const std::string& sp_path, const std::string& output_dir,
-          bool zero_shot, ::mlperf::TestMode mode);
+          bool zero_shot, ::mlperf::TestMode mode, bool early_stop = false,
+          const std::string& cache_dir = "");
 
   const std::string& Name() override { return name_; }
 
@@ -53,7 +55,13 @@ class MmluGen : public Dataset {
  private:
   const std::string name_ = "MmluGen";
 
-  char find_answer_char(const std::string& input);
+  // Returns the answer letter of input, or 0 if there is none. Unless input
+  // is complete, a letter ending the input is not taken as an answer since
+  // more text may follow.
+  char find_answer_char(const std::string& input, bool complete = true);
+
+  // token_callback streaming the output tokens when early_stop_ is set.
+  static bool OnToken(void* context, int32_t batch_index, int32_t token);
 
   TFRecordReader sample_reader_;
 
@@ -65,6 +73,21 @@ class MmluGen : public Dataset {
 
   std::vector<std::unique_ptr<PromptSample>> samples_;
   std::vector<std::vector<int>> sample_output_tokens_;
+
+  // Early stop mode, which is not valid for submission. The output of each
+  // query is detokenized while it is generated, and generation stops as soon
+  // as the answer letter is known.
+  bool early_stop_ = false;
+  struct OutputStream {
+    int sample_idx;
+    StreamingDetokenizer detokenizer;
+  };
+  // Streams of the queries in flight, by batch index. Samples are given to
+  // the backend in batch index order, see GetData.
+  std::vector<OutputStream> streams_;
+  bool streams_done_ = false;
+  // Prediction text of the samples answered during generation.
+  std::vector<std::string> streamed_predictions_;
   std::unordered_set<size_t> used_sample_ids_;
   std::set<int> loaded_sample_ids_;
   std::string raw_output_dir_;
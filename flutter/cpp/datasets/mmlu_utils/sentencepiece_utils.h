@@ -18,6 +18,7 @@ limitations under the License.
 
 #include <fstream>
 #include <string>
+#include <vector>
 
 #include "src/sentencepiece_processor.h"
 
@@ -74,6 +75,50 @@ inline static std::string FormatLlamaUserPrompt(
   return out;
 }
 
+// Detokenizes output tokens as they are produced. Each token is decoded
+// together with the previous one, so that pieces depending on their left
+// context (e.g. a leading space) come out as in a full decode. Text ending in
+// an incomplete UTF-8 sequence is held back until the next token.
+class StreamingDetokenizer {
+ public:
+  explicit StreamingDetokenizer(
+      const sentencepiece::SentencePieceProcessor* processor)
+      : processor_(processor) {}
+
+  // Adds a token and returns the text decoded so far.
+  const std::string& Add(int token) {
+    tokens_.push_back(token);
+    std::string prefix_text, new_text;
+    processor_->Decode(Slice(prefix_offset_, read_offset_), &prefix_text).ok();
+    processor_->Decode(Slice(prefix_offset_, tokens_.size()), &new_text).ok();
+    // U+FFFD stands in for an incomplete byte sequence.
+    static constexpr const char* kReplacement = "\xEF\xBF\xBD";
+    bool incomplete =
+        new_text.size() >= 3 &&
+        new_text.compare(new_text.size() - 3, 3, kReplacement) == 0;
+    if (new_text.size() > prefix_text.size() && !incomplete) {
+      text_.append(new_text, prefix_text.size(), std::string::npos);
+      prefix_offset_ = read_offset_;
+      read_offset_ = tokens_.size();
+    }
+    return text_;
+  }
+
+  const std::string& Text() const { return text_; }
+
+ private:
+  std::vector<int> Slice(size_t begin, size_t end) const {
+    return std::vector<int>(tokens_.begin() + begin, tokens_.begin() + end);
+  }
+
+  const sentencepiece::SentencePieceProcessor* processor_;
+  std::vector<int> tokens_;
+  std::string text_;
+  // tokens_[prefix_offset_, read_offset_) is the context of the next token.
+  size_t prefix_offset_ = 0;
+  size_t read_offset_ = 0;
+};
+
 }  // namespace mobile
 }  // namespace mlperf
 #endif  // MLPERF_DATASETS_MMLU_UTILS_SENTENCEPIECE_UTILS_H_
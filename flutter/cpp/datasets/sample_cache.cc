@@ -0,0 +1,196 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "flutter/cpp/datasets/sample_cache.h"
+
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#if !defined(_WIN64) && !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "tensorflow/core/platform/logging.h"
+
+namespace mlperf {
+namespace mobile {
+namespace {
+
+constexpr char kMagic[8] = {'M', 'L', 'P', 'S', 'C', 'A', 'C', '1'};
+constexpr size_t kSampleAlignment = 64;
+constexpr size_t kPageSize = 4096;
+
+// Fixed size part at the start of the cache file. It is followed by the key,
+// one flag byte per sample and the sample data at data_offset.
+struct CacheHeader {
+  char magic[8];
+  uint64_t num_samples;
+  uint64_t sample_bytes;
+  uint64_t stride;
+  uint64_t data_offset;
+  uint64_t key_size;
+};
+
+size_t RoundUp(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+}  // namespace
+
+#if defined(_WIN64) || defined(_WIN32)
+std::string SampleCache::FilesFingerprint(
+    const std::vector<std::string>& files) {
+  return "";
+}
+
+std::unique_ptr<SampleCache> SampleCache::Open(const std::string& cache_dir,
+                                               const std::string& key,
+                                               size_t num_samples,
+                                               size_t sample_bytes) {
+  LOG(WARNING) << "Sample cache is not supported on Windows";
+  return nullptr;
+}
+
+SampleCache::~SampleCache() {}
+#else
+std::string SampleCache::FilesFingerprint(
+    const std::vector<std::string>& files) {
+  // FNV-1a over the path, size and modification time of every file.
+  uint64_t hash = 14695981039346656037ull;
+  auto mix = [&hash](const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+  };
+  for (const std::string& file : files) {
+    struct stat st;
+    int64_t size = -1;
+    int64_t mtime = -1;
+    if (stat(file.c_str(), &st) == 0) {
+      size = st.st_size;
+      mtime = st.st_mtime;
+    }
+    mix(file.data(), file.size());
+    mix(&size, sizeof(size));
+    mix(&mtime, sizeof(mtime));
+  }
+  std::stringstream fingerprint;
+  fingerprint << files.size() << ":" << std::hex << std::setw(16)
+              << std::setfill('0') << hash;
+  return fingerprint.str();
+}
+
+std::unique_ptr<SampleCache> SampleCache::Open(const std::string& cache_dir,
+                                               const std::string& key,
+                                               size_t num_samples,
+                                               size_t sample_bytes) {
+  CacheHeader header;
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.num_samples = num_samples;
+  header.sample_bytes = sample_bytes;
+  header.stride = RoundUp(sample_bytes, kSampleAlignment);
+  header.key_size = key.size();
+  header.data_offset =
+      RoundUp(sizeof(CacheHeader) + key.size() + num_samples, kPageSize);
+  const size_t file_size =
+      header.data_offset + header.num_samples * header.stride;
+
+  std::stringstream path;
+  path << cache_dir << "/" << std::hex << std::setw(16) << std::setfill('0')
+       << std::hash<std::string>()(key) << ".samples";
+  int fd = open(path.str().c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    LOG(ERROR) << "Failed to open sample cache " << path.str();
+    return nullptr;
+  }
+
+  // Reuse the file only if it was written for the same key and layout.
+  bool valid = false;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == file_size) {
+    CacheHeader stored;
+    std::vector<char> stored_key(key.size());
+    valid = pread(fd, &stored, sizeof(stored), 0) == sizeof(stored) &&
+            std::memcmp(&stored, &header, sizeof(header)) == 0 &&
+            pread(fd, stored_key.data(), key.size(), sizeof(header)) ==
+                static_cast<ssize_t>(key.size()) &&
+            std::memcmp(stored_key.data(), key.data(), key.size()) == 0;
+  }
+  if (!valid) {
+    LOG(INFO) << "Creating sample cache " << path.str();
+    // Truncating to 0 first clears the flags of a previous layout.
+    if (ftruncate(fd, 0) != 0 || ftruncate(fd, file_size) != 0 ||
+        pwrite(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        pwrite(fd, key.data(), key.size(), sizeof(header)) !=
+            static_cast<ssize_t>(key.size())) {
+      LOG(ERROR) << "Failed to create sample cache " << path.str();
+      close(fd);
+      return nullptr;
+    }
+  }
+
+  void* mapping =
+      mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mapping == MAP_FAILED) {
+    LOG(ERROR) << "Failed to map sample cache " << path.str();
+    close(fd);
+    return nullptr;
+  }
+
+  std::unique_ptr<SampleCache> cache(new SampleCache());
+  cache->fd_ = fd;
+  cache->mapping_ = static_cast<uint8_t*>(mapping);
+  cache->mapping_size_ = file_size;
+  cache->flags_ = cache->mapping_ + sizeof(header) + key.size();
+  cache->data_ = cache->mapping_ + header.data_offset;
+  cache->num_samples_ = num_samples;
+  cache->sample_bytes_ = sample_bytes;
+  cache->stride_ = header.stride;
+  return cache;
+}
+
+SampleCache::~SampleCache() {
+  if (mapping_) munmap(mapping_, mapping_size_);
+  if (fd_ >= 0) close(fd_);
+}
+#endif
+
+bool SampleCache::Contains(size_t sample_idx) const {
+  return sample_idx < num_samples_ && flags_[sample_idx] != 0;
+}
+
+uint8_t* SampleCache::Data(size_t sample_idx) const {
+  return data_ + sample_idx * stride_;
+}
+
+void SampleCache::Load(size_t sample_idx, uint8_t* data) const {
+  std::memcpy(data, Data(sample_idx), sample_bytes_);
+}
+
+void SampleCache::Store(size_t sample_idx, const uint8_t* data) {
+  std::memcpy(Data(sample_idx), data, sample_bytes_);
+  // The flag is set last so that an interrupted run never marks a partially
+  // written sample as valid.
+  flags_[sample_idx] = 1;
+}
+
+}  // namespace mobile
+}  // namespace mlperf
@@ -0,0 +1,75 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef MLPERF_DATASETS_SAMPLE_CACHE_H_
+#define MLPERF_DATASETS_SAMPLE_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mlperf {
+namespace mobile {
+
+// SampleCache stores preprocessed samples of a dataset in a single file that
+// is memory mapped, so later runs with the same key can use the samples
+// without decoding them. Samples are written the first time they are loaded.
+// Datasets copy cached samples into buffers allocated by the backend, so
+// backends that need their own input memory see no difference.
+class SampleCache {
+ public:
+  // Opens the cache for key under cache_dir, creating it if it does not exist
+  // or was written with a different key or layout. Returns nullptr if the
+  // cache cannot be used.
+  static std::unique_ptr<SampleCache> Open(const std::string& cache_dir,
+                                           const std::string& key,
+                                           size_t num_samples,
+                                           size_t sample_bytes);
+
+  // Summarizes the path, size and modification time of files. Adding it to
+  // the key makes the cache invalid once any of the files changes.
+  static std::string FilesFingerprint(const std::vector<std::string>& files);
+
+  ~SampleCache();
+
+  // Returns true if the sample has been stored.
+  bool Contains(size_t sample_idx) const;
+
+  // Copies the sample_bytes of a stored sample to data.
+  void Load(size_t sample_idx, uint8_t* data) const;
+
+  // Copies sample_bytes of data into the cache.
+  void Store(size_t sample_idx, const uint8_t* data);
+
+ private:
+  SampleCache() = default;
+
+  uint8_t* Data(size_t sample_idx) const;
+
+  int fd_ = -1;
+  uint8_t* mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  uint8_t* flags_ = nullptr;
+  uint8_t* data_ = nullptr;
+  size_t num_samples_ = 0;
+  size_t sample_bytes_ = 0;
+  size_t stride_ = 0;
+};
+
+}  // namespace mobile
+}  // namespace mlperf
+
+#endif  // MLPERF_DATASETS_SAMPLE_CACHE_H_
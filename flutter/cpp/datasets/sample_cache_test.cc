@@ -0,0 +1,99 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "flutter/cpp/datasets/sample_cache.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace mlperf {
+namespace mobile {
+namespace {
+
+constexpr size_t kNumSamples = 3;
+constexpr size_t kSampleBytes = 100;
+
+std::vector<uint8_t> Sample(uint8_t seed) {
+  std::vector<uint8_t> sample(kSampleBytes);
+  for (size_t i = 0; i < kSampleBytes; ++i) sample[i] = seed + i;
+  return sample;
+}
+
+TEST(SampleCache, StoresAndReopens) {
+  const std::string dir = ::testing::TempDir();
+  {
+    auto cache = SampleCache::Open(dir, "reopen", kNumSamples, kSampleBytes);
+    ASSERT_NE(cache, nullptr);
+    EXPECT_FALSE(cache->Contains(0));
+    cache->Store(1, Sample(7).data());
+    EXPECT_TRUE(cache->Contains(1));
+    EXPECT_FALSE(cache->Contains(kNumSamples));
+  }
+  auto cache = SampleCache::Open(dir, "reopen", kNumSamples, kSampleBytes);
+  ASSERT_NE(cache, nullptr);
+  EXPECT_FALSE(cache->Contains(0));
+  ASSERT_TRUE(cache->Contains(1));
+  std::vector<uint8_t> loaded(kSampleBytes);
+  cache->Load(1, loaded.data());
+  EXPECT_EQ(loaded, Sample(7));
+}
+
+TEST(SampleCache, DropsSamplesOnLayoutMismatch) {
+  const std::string dir = ::testing::TempDir();
+  {
+    auto cache = SampleCache::Open(dir, "layout", kNumSamples, kSampleBytes);
+    ASSERT_NE(cache, nullptr);
+    cache->Store(0, Sample(1).data());
+  }
+  // Same key with another sample size.
+  auto cache = SampleCache::Open(dir, "layout", kNumSamples, kSampleBytes + 1);
+  ASSERT_NE(cache, nullptr);
+  EXPECT_FALSE(cache->Contains(0));
+}
+
+TEST(SampleCache, KeysIncludeImageFingerprint) {
+  const std::string dir = ::testing::TempDir();
+  const std::string image = dir + "/sample_cache_test_image.rgb8";
+  std::ofstream(image) << "image";
+  const std::string key = "images|" + SampleCache::FilesFingerprint({image});
+  {
+    auto cache = SampleCache::Open(dir, key, kNumSamples, kSampleBytes);
+    ASSERT_NE(cache, nullptr);
+    cache->Store(2, Sample(3).data());
+  }
+  EXPECT_EQ(SampleCache::FilesFingerprint({image}), key.substr(7));
+
+  // A different image size gives another key, so the stored sample is not
+  // used for the new image.
+  std::ofstream(image) << "another image";
+  const std::string changed_key =
+      "images|" + SampleCache::FilesFingerprint({image});
+  EXPECT_NE(changed_key, key);
+  auto cache = SampleCache::Open(dir, changed_key, kNumSamples, kSampleBytes);
+  ASSERT_NE(cache, nullptr);
+  EXPECT_FALSE(cache->Contains(2));
+}
+
+}  // namespace
+}  // namespace mobile
+}  // namespace mlperf
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -12,6 +12,7 @@ limitations under the License.
 
 #include "flutter/cpp/datasets/snu_sr.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <fstream>
 #include <iomanip>
@@ -29,10 +30,14 @@ limitations under the License.
 
 namespace mlperf {
 namespace mobile {
+namespace {
+// Number of pixels handled by one task when computing the PSNR.
+constexpr int kPixelsPerChunk = 64 * 1024;
+}  // namespace
 
 SNUSR::SNUSR(Backend *backend, const std::string &image_dir,
              const std::string &ground_truth_dir, int num_channels, int scale,
-             int image_width, int image_height)
+             int image_width, int image_height, int loader_threads)
     : Dataset(backend),
       num_channels_(num_channels),
       scale_(scale),
@@ -72,11 +77,7 @@ SNUSR::SNUSR(Backend *backend, const std::string &image_dir,
   if (input_format_.at(0).type == DataType::Int8) {
     builder.AddDefaultNormalizationStep();
   }
-  preprocessing_stage_.reset(
-      new tflite::evaluation::ImagePreprocessingStage(builder.build()));
-  if (preprocessing_stage_->Init() != kTfLiteOk) {
-    LOG(FATAL) << "Failed to init preprocessing stage";
-  }
+  image_loader_.reset(new ImageLoader(builder.build(), loader_threads));
 
   // Always use uint8_t for ground truth image
   tflite::evaluation::ImagePreprocessingConfigBuilder gt_builder("ground_truth",
@@ -92,33 +93,9 @@ SNUSR::SNUSR(Backend *backend, const std::string &image_dir,
 }
 
 void SNUSR::LoadSamplesToRam(const std::vector<QuerySampleIndex> &samples) {
-  for (QuerySampleIndex sample_idx : samples) {
-    // Preprocessing.
-    if (sample_idx >= image_list_.size()) {
-      LOG(FATAL) << "Sample index out of bound";
-    }
-    std::string filename = image_list_.at(sample_idx);
-    preprocessing_stage_->SetImagePath(&filename);
-    if (preprocessing_stage_->Run() != kTfLiteOk) {
-      LOG(FATAL) << "Failed to run preprocessing stage";
-    }
-
-    // Move data out of preprocessing_stage_ so it can be reused.
-    auto total_byte = input_format_[0].size * GetByte(input_format_[0]);
-    auto data_void = preprocessing_stage_->GetPreprocessedImageData();
-    auto data_uint8 =
-        new std::vector<uint8_t, BackendAllocator<uint8_t>>(total_byte);
-
-    std::copy(static_cast<uint8_t *>(data_void),
-              static_cast<uint8_t *>(data_void) + total_byte,
-              data_uint8->begin());
-
-    // Allow backend to convert data layout if needed
-    backend_->ConvertInputs(total_byte, image_width_, image_height_,
-                            data_uint8->data());
-
-    samples_.at(sample_idx).push_back(data_uint8);
-  }
+  int total_byte = input_format_[0].size * GetByte(input_format_[0]);
+  image_loader_->LoadSamples(samples, image_list_, total_byte, image_width_,
+                             image_height_, backend_, &samples_);
 }
 
 void SNUSR::UnloadSamplesFromRam(const std::vector<QuerySampleIndex> &samples) {
@@ -166,17 +143,30 @@ std::vector<uint8_t> SNUSR::ProcessOutput(const int sample_idx,
     // psnr calculating code
     int n_pixels =
         image_width_ * image_height_ * num_channels_ * scale_ * scale_;
-    float mse = 0;
-    for (int i = 0; i < n_pixels; i++) {
-      uint8_t p;
-      if (isOutputFloat) {
-        p = (uint8_t)(0x000000ff & (int32_t)outputFloat[i]);
-      } else if (isOutputUint8) {
-        p = outputUint8[i];
-      } else {
-        p = (uint8_t)(0x000000ff & (outputInt8[i] + 128));
+    // The squared errors are summed per fixed-size chunk and the chunks are
+    // added in order, so the result does not depend on the thread count.
+    int n_chunks = (n_pixels + kPixelsPerChunk - 1) / kPixelsPerChunk;
+    std::vector<float> chunk_se(n_chunks, 0.0f);
+    EvaluationPool().ParallelFor(n_chunks, [&](size_t chunk, int) {
+      int begin = static_cast<int>(chunk) * kPixelsPerChunk;
+      int end = std::min(begin + kPixelsPerChunk, n_pixels);
+      float se = 0;
+      for (int i = begin; i < end; i++) {
+        uint8_t p;
+        if (isOutputFloat) {
+          p = (uint8_t)(0x000000ff & (int32_t)outputFloat[i]);
+        } else if (isOutputUint8) {
+          p = outputUint8[i];
+        } else {
+          p = (uint8_t)(0x000000ff & (outputInt8[i] + 128));
+        }
+        se += (ground_truth_vector[i] - p) * (ground_truth_vector[i] - p) * 1.0;
       }
-      mse += (ground_truth_vector[i] - p) * (ground_truth_vector[i] - p) * 1.0;
+      chunk_se[chunk] = se;
+    });
+    float mse = 0;
+    for (float se : chunk_se) {
+      mse += se;
     }
     mse = mse / n_pixels;
     auto sample_psnr_ = -10 * log10f(mse / (255.0 * 255.0));
@@ -19,6 +19,7 @@ limitations under the License.
 
 #include "allocator.h"
 #include "flutter/cpp/dataset.h"
+#include "flutter/cpp/datasets/image_loader.h"
 #include "flutter/cpp/datasets/utils.h"
 #include "tensorflow/lite/tools/evaluation/stages/image_preprocessing_stage.h"
 
@@ -31,10 +32,11 @@ class SNUSR : public Dataset {
   // SNU-SR assumes that there is a single input resevered for the image
   // data and single output which contains scaled-up super-resultion image.
   // The order of images under image_dir should be the same as the original
-  // SNU-SR dataset.
+  // SNU-SR dataset. loader_threads is the number of threads preprocessing
+  // images, 0 uses one per hardware thread.
   SNUSR(Backend *backend, const std::string &image_dir,
         const std::string &ground_truth_dir, int num_channels, int scale,
-        int image_width, int image_height);
+        int image_width, int image_height, int loader_threads = 0);
 
   // Returns the name of the dataset.
   const std::string &Name() override { return name_; }
@@ -81,9 +83,8 @@ class SNUSR : public Dataset {
   std::vector<std::vector<std::vector<uint8_t, BackendAllocator<uint8_t>> *>>
       samples_;
 
-  // preprocessing_stage_ conducts preprocessing of images.
-  std::unique_ptr<tflite::evaluation::ImagePreprocessingStage>
-      preprocessing_stage_;
+  // image_loader_ conducts preprocessing of images.
+  std::unique_ptr<ImageLoader> image_loader_;
   // gt_preprocessing_stage_ for load ground truth images.
   std::unique_ptr<tflite::evaluation::ImagePreprocessingStage>
       gt_preprocessing_stage_;
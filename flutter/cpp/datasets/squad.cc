@@ -99,7 +99,7 @@ Squad::Squad(Backend* backend, const std::string& input_tfrecord,
 void Squad::LoadSamplesToRam(const std::vector<QuerySampleIndex>& samples) {
   // using int64 = google::protobuf::int64;
   for (QuerySampleIndex sample_idx : samples) {
-    tensorflow::tstring record = sample_reader_.ReadRecord(sample_idx);
+    std::string_view record = sample_reader_.ReadRecord(sample_idx);
     samples_.at(sample_idx)
         .reset(SampleRecordFactory::create(record, input_format_[0].type));
   }
@@ -126,90 +126,117 @@ std::vector<uint8_t> Squad::ProcessOutput(const int sample_idx,
 
 bool Squad::HasAccuracy() { return gt_reader_ != nullptr; }
 
-float Squad::ComputeAccuracy() {
-  if (gt_reader_ == nullptr) {
-    return -1.0f;
-  }
-  float final_score = 0.0f;
-  for (auto& it : qas_id_to_samples_) {
-    const std::string& qas_id = it.first;
-    // Find candidates for the best prediction.
-    PrelimPrediction best_pred(0, 0, 0, -std::numeric_limits<float>::max());
-    for (uint32_t sample_index : it.second) {
-      if (predictions_[sample_index] == nullptr) continue;
-      SampleRecord<int32_t> sample(sample_reader_.ReadRecord(sample_index));
-      // Get top start and end indexes based on their logit.
-      std::vector<int32_t> top_start_indexes =
-          GetTopK(predictions_[sample_index]->start_logit_.data(),
-                  predictions_[sample_index]->start_logit_.size(), K, 0);
-      std::vector<int32_t> top_end_indexes =
-          GetTopK(predictions_[sample_index]->end_logit_.data(),
-                  predictions_[sample_index]->end_logit_.size(), K, 0);
-
-      for (int32_t start_index : top_start_indexes) {
-        for (int32_t end_index : top_end_indexes) {
-          // Ignore all couple of invalid indexes.
-          if (end_index < start_index) continue;
-          if (end_index - start_index + 1 > kMaxAnswerLength) continue;
-          if (start_index >= sample.span_tokens_.size() ||
-              end_index >= sample.span_tokens_.size())
-            continue;
-
-          // Ignore couples contain query tokens.
-          if (start_index < sample.query_tokens_length_ ||
-              end_index < sample.query_tokens_length_)
-            continue;
-
-          // Only keep the couple with max context.
-          if (!sample.token_is_max_context_[start_index -
-                                            sample.query_tokens_length_])
-            continue;
-
-          // Store the valid candidate.
-          float score = predictions_[sample_index]->start_logit_[start_index] +
-                        predictions_[sample_index]->end_logit_[end_index];
-          if (score > best_pred.score) {
-            best_pred =
-                PrelimPrediction(sample_index, start_index, end_index, score);
-          }
+float Squad::ComputeQuestionScore(
+    const std::string& qas_id, const std::vector<uint32_t>& sample_indexes) {
+  // Find candidates for the best prediction.
+  PrelimPrediction best_pred(0, 0, 0, -std::numeric_limits<float>::max());
+  // Each sample is parsed once and the one of the best prediction is kept
+  // to extract the answer text.
+  std::unique_ptr<SampleRecord<int32_t>> best_sample;
+  for (uint32_t sample_index : sample_indexes) {
+    if (predictions_[sample_index] == nullptr) continue;
+    auto parsed = std::make_unique<SampleRecord<int32_t>>(
+        sample_reader_.ReadRecord(sample_index));
+    const SampleRecord<int32_t>& sample = *parsed;
+    bool is_best = false;
+    // Get top start and end indexes based on their logit.
+    std::vector<int32_t> top_start_indexes =
+        GetTopK(predictions_[sample_index]->start_logit_.data(),
+                predictions_[sample_index]->start_logit_.size(), K, 0);
+    std::vector<int32_t> top_end_indexes =
+        GetTopK(predictions_[sample_index]->end_logit_.data(),
+                predictions_[sample_index]->end_logit_.size(), K, 0);
+
+    for (int32_t start_index : top_start_indexes) {
+      for (int32_t end_index : top_end_indexes) {
+        // Ignore all couple of invalid indexes.
+        if (end_index < start_index) continue;
+        if (end_index - start_index + 1 > kMaxAnswerLength) continue;
+        if (start_index >= sample.span_tokens_.size() ||
+            end_index >= sample.span_tokens_.size())
+          continue;
+
+        // Ignore couples contain query tokens.
+        if (start_index < sample.query_tokens_length_ ||
+            end_index < sample.query_tokens_length_)
+          continue;
+
+        // Only keep the couple with max context.
+        if (!sample.token_is_max_context_[start_index -
+                                          sample.query_tokens_length_])
+          continue;
+
+        // Store the valid candidate.
+        float score = predictions_[sample_index]->start_logit_[start_index] +
+                      predictions_[sample_index]->end_logit_[end_index];
+        if (score > best_pred.score) {
+          best_pred =
+              PrelimPrediction(sample_index, start_index, end_index, score);
+          is_best = true;
         }
       }
     }
+    if (is_best) best_sample = std::move(parsed);
+  }
 
-    // Get the text from span tokens.
-    SampleRecord<int32_t> sample(
+  // Get the text from span tokens.
+  if (best_sample == nullptr) {
+    best_sample = std::make_unique<SampleRecord<int32_t>>(
         sample_reader_.ReadRecord(best_pred.sample_index));
-    std::string pred_tokens = sample.span_tokens_[best_pred.start_index];
-    for (int i = best_pred.start_index + 1; i <= best_pred.end_index; ++i) {
-      absl::StrAppend(&pred_tokens, " ", sample.span_tokens_[i]);
-    }
-    // De-tokenize WordPieces that have been split off.
-    pred_tokens = absl::StrReplaceAll(pred_tokens, {{" ##", ""}, {"##", ""}});
-    // Clean whitespace.
-    absl::RemoveExtraAsciiWhitespace(&pred_tokens);
-
-    // Get the text from original tokens.
-    int doc_start = sample.token_index_map_[best_pred.start_index -
-                                            sample.query_tokens_length_];
-    int doc_end = sample.token_index_map_[best_pred.end_index -
+  }
+  const SampleRecord<int32_t>& sample = *best_sample;
+  std::string pred_tokens = sample.span_tokens_[best_pred.start_index];
+  for (int i = best_pred.start_index + 1; i <= best_pred.end_index; ++i) {
+    absl::StrAppend(&pred_tokens, " ", sample.span_tokens_[i]);
+  }
+  // De-tokenize WordPieces that have been split off.
+  pred_tokens = absl::StrReplaceAll(pred_tokens, {{" ##", ""}, {"##", ""}});
+  // Clean whitespace.
+  absl::RemoveExtraAsciiWhitespace(&pred_tokens);
+
+  // Get the text from original tokens.
+  int doc_start = sample.token_index_map_[best_pred.start_index -
                                           sample.query_tokens_length_];
-    GroundTruthRecord gt_record(
-        gt_reader_->ReadRecord(qas_id_to_ground_truth_[qas_id]));
-    if (gt_record.tokens.size() <= doc_start ||
-        gt_record.words.size() <= doc_start)
-      continue;
-    std::string orig_tokens = gt_record.tokens[doc_start];
-    std::string orig_words = gt_record.words[doc_start];
-    for (int i = doc_start + 1; i <= doc_end; ++i) {
-      if (gt_record.tokens.size() <= i || gt_record.words.size() <= i) continue;
-      absl::StrAppend(&orig_tokens, " ", gt_record.tokens[i]);
-      absl::StrAppend(&orig_words, " ", gt_record.words[i]);
-    }
+  int doc_end = sample.token_index_map_[best_pred.end_index -
+                                        sample.query_tokens_length_];
+  auto gt_it = qas_id_to_ground_truth_.find(qas_id);
+  GroundTruthRecord gt_record(gt_reader_->ReadRecord(
+      gt_it != qas_id_to_ground_truth_.end() ? gt_it->second : 0));
+  if (gt_record.tokens.size() <= doc_start ||
+      gt_record.words.size() <= doc_start)
+    return 0.0f;
+  std::string orig_tokens = gt_record.tokens[doc_start];
+  std::string orig_words = gt_record.words[doc_start];
+  for (int i = doc_start + 1; i <= doc_end; ++i) {
+    if (gt_record.tokens.size() <= i || gt_record.words.size() <= i) continue;
+    absl::StrAppend(&orig_tokens, " ", gt_record.tokens[i]);
+    absl::StrAppend(&orig_words, " ", gt_record.words[i]);
+  }
 
-    // Get the final answer.
-    std::string final_text =
-        get_final_text(pred_tokens, orig_tokens, orig_words);
-    final_score += F1Score(gt_record.answers, final_text);
+  // Get the final answer.
+  std::string final_text =
+      get_final_text(pred_tokens, orig_tokens, orig_words);
+  return F1Score(gt_record.answers, final_text);
+}
+
+float Squad::ComputeAccuracy() {
+  if (gt_reader_ == nullptr) {
+    return -1.0f;
+  }
+  // Questions are scored in parallel and summed in a fixed order.
+  std::vector<const std::pair<const std::string, std::vector<uint32_t>>*>
+      questions;
+  questions.reserve(qas_id_to_samples_.size());
+  for (const auto& it : qas_id_to_samples_) {
+    questions.push_back(&it);
+  }
+  std::vector<float> scores(questions.size());
+  EvaluationPool().ParallelFor(questions.size(), [&](size_t i, int) {
+    scores[i] = ComputeQuestionScore(questions[i]->first, questions[i]->second);
+  });
+  float final_score = 0.0f;
+  for (float score : scores) {
+    final_score += score;
   }
   return final_score / qas_id_to_samples_.size();
 }
@@ -75,6 +75,10 @@ class Squad : public Dataset {
   inline std::string ComputeAccuracyString() override;
 
  private:
+  // Returns the F1 score of the best answer among the samples of a question.
+  float ComputeQuestionScore(const std::string& qas_id,
+                             const std::vector<uint32_t>& sample_indexes);
+
   const std::string name_ = "SQuAD 1.1";
   // The random access reader to read input TFRecord file.
   TFRecordReader sample_reader_;
@@ -15,7 +15,18 @@ limitations under the License.
 #ifndef MLPERF_DATASETS_SQUAD_UTILS_TFRECORD_READER_H_
 #define MLPERF_DATASETS_SQUAD_UTILS_TFRECORD_READER_H_
 
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "tensorflow/core/lib/hash/crc32c.h"
 #include "tensorflow/core/lib/io/record_reader.h"
+#include "tensorflow/core/platform/env.h"
 
 namespace mlperf {
 namespace mobile {
@@ -23,43 +34,222 @@ namespace mobile {
 // TFRecordReader is similar to tensorflow::io::RecordReader. However, it allows
 // users to get the number of records in the file and random access to a record
 // using its index instead of offset.
+//
+// Uncompressed files are memory mapped and records are returned as views into
+// the mapping. The CRC of a record is checked the first time it is read. A
+// ZLIB stream can only be inflated from its start, so ZLIB files are
+// decompressed in one sequential pass when the reader is created and all
+// records are kept in memory. In both cases the returned view is valid as
+// long as the reader exists.
+//
+// The offsets of the records of an uncompressed file are saved in a sidecar
+// file next to it, so only the first run needs to scan the whole file. The
+// sidecar is rebuilt when the size or modification time of the TFRecord file
+// changes.
 class TFRecordReader {
  public:
   TFRecordReader(const std::string& filename) {
-    TF_CHECK_OK(tensorflow::Env::Default()->NewRandomAccessFile(
-        filename, &random_access_file_));
-    auto options =
-        tensorflow::io::RecordReaderOptions::CreateRecordReaderOptions("ZLIB");
-    reader_.reset(
-        new tensorflow::io::RecordReader(random_access_file_.get(), options));
+    tensorflow::FileStatistics stat;
+    TF_CHECK_OK(tensorflow::Env::Default()->Stat(filename, &stat));
+    if (stat.length > 0) {
+      TF_CHECK_OK(tensorflow::Env::Default()->NewReadOnlyMemoryRegionFromFile(
+          filename, &region_));
+      if (!IsUncompressed()) {
+        region_.reset();
+        ReadCompressedRecords(filename);
+        return;
+      }
 
-    tensorflow::uint64 id = 0, offset = 0, noffset = 0;
-    tensorflow::tstring record;
-    while (reader_->ReadRecord(&noffset, &record).ok()) {
-      index_to_offset_[id++] = offset;
-      offset = noffset;
+      const std::string index_file = filename + kIndexSuffix;
+      if (!LoadIndex(index_file, stat)) {
+        ScanMappedRecords();
+        SaveIndex(index_file, stat);
+      }
+      is_ready_.resize(index_to_offset_.size(), 0);
     }
   }
 
-  tensorflow::tstring ReadRecord(int idx) {
-    if (idx >= index_to_offset_.size()) {
+  std::string_view ReadRecord(int idx) {
+    if (idx < 0 || static_cast<uint32_t>(idx) >= Size()) {
       LOG(FATAL) << "Sample index out of bound";
     }
+    if (region_) return ReadMappedRecord(idx);
+    return std::string_view(records_[idx].data(), records_[idx].size());
+  }
+
+  uint32_t Size() {
+    return region_ ? index_to_offset_.size() : records_.size();
+  }
+
+ private:
+  static constexpr char kIndexSuffix[] = ".idx";
+  static constexpr uint64_t kIndexMagic = 0x3130584449524654;  // "TFRIDX01"
+  // A record is stored as: uint64 length, uint32 masked crc32c of length,
+  // data, uint32 masked crc32c of data. Integers are little endian.
+  static constexpr size_t kHeaderSize = sizeof(uint64_t) + sizeof(uint32_t);
+  static constexpr size_t kFooterSize = sizeof(uint32_t);
+
+  // Header of the sidecar index file. It is followed by num_records offsets.
+  struct IndexHeader {
+    uint64_t magic;
+    uint64_t file_size;
+    int64_t mtime_nsec;
+    uint64_t num_records;
+  };
+
+  const char* MappedData() const {
+    return static_cast<const char*>(region_->data());
+  }
+
+  template <typename T>
+  T DecodeFixed(const char* ptr) const {
+    T value;
+    std::memcpy(&value, ptr, sizeof(value));
+    return value;
+  }
+
+  // Returns the length of the record at offset in the mapping, or -1 if the
+  // record header is truncated or corrupted.
+  int64_t MappedRecordLength(uint64_t offset) const {
+    if (offset + kHeaderSize + kFooterSize > region_->length()) return -1;
+    const char* header = MappedData() + offset;
+    uint64_t length = DecodeFixed<uint64_t>(header);
+    uint32_t masked_crc = DecodeFixed<uint32_t>(header + sizeof(uint64_t));
+    if (tensorflow::crc32c::Unmask(masked_crc) !=
+        tensorflow::crc32c::Value(header, sizeof(uint64_t))) {
+      return -1;
+    }
+    if (length > region_->length() - offset - kHeaderSize - kFooterSize) {
+      return -1;
+    }
+    return static_cast<int64_t>(length);
+  }
+
+  // ZLIB files almost never start with a valid uncompressed record header, so
+  // the CRC of the first length tells the two formats apart.
+  bool IsUncompressed() const { return MappedRecordLength(0) >= 0; }
+
+  void ScanMappedRecords() {
+    uint64_t offset = 0;
+    while (offset < region_->length()) {
+      int64_t length = MappedRecordLength(offset);
+      if (length < 0) {
+        LOG(FATAL) << "Corrupted tfrecord file";
+      }
+      index_to_offset_.push_back(offset);
+      offset += kHeaderSize + length + kFooterSize;
+    }
+  }
+
+  void ReadCompressedRecords(const std::string& filename) {
+    std::unique_ptr<tensorflow::RandomAccessFile> file;
+    TF_CHECK_OK(
+        tensorflow::Env::Default()->NewRandomAccessFile(filename, &file));
+    auto options =
+        tensorflow::io::RecordReaderOptions::CreateRecordReaderOptions("ZLIB");
+    tensorflow::io::RecordReader reader(file.get(), options);
+    // Reading forward from the previous record never restarts the inflation.
+    tensorflow::uint64 offset = 0;
     tensorflow::tstring record;
-    tensorflow::uint64 offset = index_to_offset_[idx];
-    if (!reader_->ReadRecord(&offset, &record).ok()) {
+    while (reader.ReadRecord(&offset, &record).ok()) {
+      records_.push_back(std::move(record));
+    }
+  }
+
+  std::string_view ReadMappedRecord(int idx) {
+    uint64_t offset = index_to_offset_[idx];
+    int64_t length = MappedRecordLength(offset);
+    if (length < 0) {
       LOG(FATAL) << "Failed to read tfrecord file";
     }
-    return record;
+    const char* data = MappedData() + offset + kHeaderSize;
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!is_ready_[idx]) {
+      uint32_t masked_crc = DecodeFixed<uint32_t>(data + length);
+      if (tensorflow::crc32c::Unmask(masked_crc) !=
+          tensorflow::crc32c::Value(data, length)) {
+        LOG(FATAL) << "Corrupted record " << idx << " in tfrecord file";
+      }
+      is_ready_[idx] = 1;
+    }
+    return std::string_view(data, length);
+  }
+
+  bool LoadIndex(const std::string& index_file,
+                 const tensorflow::FileStatistics& stat) {
+    std::ifstream in(index_file, std::ios::binary | std::ios::ate);
+    if (!in) return false;
+    uint64_t index_size = static_cast<uint64_t>(in.tellg());
+    in.seekg(0);
+    IndexHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        header.magic != kIndexMagic ||
+        header.file_size != static_cast<uint64_t>(stat.length) ||
+        header.mtime_nsec != stat.mtime_nsec) {
+      return false;
+    }
+    // The count is checked against the size of the sidecar before allocating,
+    // so a corrupted index is rescanned instead of exhausting memory.
+    uint64_t offsets_size = index_size - sizeof(header);
+    if (header.num_records != offsets_size / sizeof(uint64_t)) return false;
+    index_to_offset_.resize(header.num_records);
+    if (!in.read(reinterpret_cast<char*>(index_to_offset_.data()),
+                 header.num_records * sizeof(uint64_t)) ||
+        !IsValidIndex(stat)) {
+      index_to_offset_.clear();
+      return false;
+    }
+    return true;
+  }
+
+  // Returns true if the offsets start at 0, increase and lie in the file.
+  bool IsValidIndex(const tensorflow::FileStatistics& stat) const {
+    for (size_t i = 0; i < index_to_offset_.size(); ++i) {
+      uint64_t offset = index_to_offset_[i];
+      if (offset >= static_cast<uint64_t>(stat.length) ||
+          (i == 0 ? offset != 0 : offset <= index_to_offset_[i - 1])) {
+        return false;
+      }
+    }
+    return true;
   }
 
-  uint32_t Size() { return index_to_offset_.size(); }
+  void SaveIndex(const std::string& index_file,
+                 const tensorflow::FileStatistics& stat) {
+    IndexHeader header{kIndexMagic, static_cast<uint64_t>(stat.length),
+                       stat.mtime_nsec, index_to_offset_.size()};
+    // Writes to a temporary file first so a partially written index is never
+    // picked up by a later run.
+    const std::string tmp_file = index_file + ".tmp";
+    {
+      std::ofstream out(tmp_file, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      out.write(reinterpret_cast<const char*>(index_to_offset_.data()),
+                index_to_offset_.size() * sizeof(uint64_t));
+      if (!out.good()) {
+        LOG(WARNING) << "Could not write the tfrecord index " << index_file;
+        out.close();
+        std::remove(tmp_file.c_str());
+        return;
+      }
+    }
+    if (std::rename(tmp_file.c_str(), index_file.c_str()) != 0) {
+      LOG(WARNING) << "Could not write the tfrecord index " << index_file;
+      std::remove(tmp_file.c_str());
+    }
+  }
 
- private:
-  std::unique_ptr<tensorflow::RandomAccessFile> random_access_file_;
-  std::unique_ptr<tensorflow::io::RecordReader> reader_;
-  // Map the Record index to its offset.
-  std::unordered_map<uint32_t, tensorflow::uint64> index_to_offset_;
+  // Mapping of an uncompressed file. Null for ZLIB files.
+  std::unique_ptr<tensorflow::ReadOnlyMemoryRegion> region_;
+  // Offset of each record of an uncompressed file, indexed by the record
+  // index.
+  std::vector<uint64_t> index_to_offset_;
+  // Whether a record of an uncompressed file has been CRC checked.
+  std::vector<uint8_t> is_ready_;
+  // Guards is_ready_.
+  std::mutex mutex_;
+  // Decompressed records of a ZLIB file.
+  std::vector<tensorflow::tstring> records_;
 };
 }  // namespace mobile
 }  // namespace mlperf
@@ -15,6 +15,8 @@ limitations under the License.
 #ifndef MLPERF_DATASETS_SQUAD_UTILS_TYPES_H_
 #define MLPERF_DATASETS_SQUAD_UTILS_TYPES_H_
 
+#include <string_view>
+
 #include "tensorflow/core/example/example.pb.h"
 #include "tensorflow/core/example/feature_util.h"
 #include "tensorflow/core/platform/types.h"
@@ -24,10 +26,10 @@ namespace mobile {
 
 // GroundTruthRecord is equivlent to records in the ground truth tfrecord file.
 struct GroundTruthRecord {
-  explicit GroundTruthRecord(const tensorflow::tstring& record) {
+  explicit GroundTruthRecord(std::string_view record) {
     using string = std::string;
     tensorflow::Example example;
-    CHECK(example.ParseFromString(record));
+    CHECK(example.ParseFromArray(record.data(), record.size()));
 
     qas_id = tensorflow::GetFeatureValues<string>("qas_id", example)[0];
 
@@ -64,11 +66,11 @@ class ISampleRecord {
 template <typename T>
 class SampleRecord : public ISampleRecord {
  public:
-  explicit SampleRecord(const tensorflow::tstring& record) {
+  explicit SampleRecord(std::string_view record) {
     using int64 = google::protobuf::int64;
     using string = std::string;
     tensorflow::Example example;
-    CHECK(example.ParseFromString(record));
+    CHECK(example.ParseFromArray(record.data(), record.size()));
     // Data is stored as int64 in the tfrecord file so they need to be
     // converted to int32. Input_ids is in range [0, 30000).
     auto input_ids_values =
@@ -135,8 +137,7 @@ class SampleRecord : public ISampleRecord {
 
 class SampleRecordFactory {
  public:
-  static ISampleRecord* create(const tensorflow::tstring& record,
-                               DataType::Type type) {
+  static ISampleRecord* create(std::string_view record, DataType::Type type) {
     if (type == DataType::Float32)
       return new SampleRecord<float>(record);
     else if (type == DataType::Int32)
@@ -0,0 +1,156 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "flutter/cpp/datasets/token_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+#include "tensorflow/core/platform/logging.h"
+
+namespace mlperf {
+namespace mobile {
+namespace {
+
+constexpr char kMagic[8] = {'M', 'L', 'P', 'T', 'O', 'K', 'C', '1'};
+
+// Hash of the file content, so a replaced tokenizer model with the same name
+// invalidates the cache.
+size_t ContentHash(const std::string& path) {
+  std::ifstream input(path, std::ios::binary);
+  std::string content((std::istreambuf_iterator<char>(input)),
+                      std::istreambuf_iterator<char>());
+  return std::hash<std::string>()(content);
+}
+
+// The dataset file is larger, its size and modification time identify it.
+std::string FileStamp(const std::string& path) {
+  std::error_code ec;
+  std::stringstream stamp;
+  stamp << std::filesystem::file_size(path, ec) << ":"
+        << std::filesystem::last_write_time(path, ec)
+               .time_since_epoch()
+               .count();
+  return stamp.str();
+}
+
+template <typename T>
+void Write(std::ostream& out, const T& value) {
+  out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool Read(std::istream& in, T* value) {
+  return static_cast<bool>(
+      in.read(reinterpret_cast<char*>(value), sizeof(*value)));
+}
+
+}  // namespace
+
+TokenCache::TokenCache(const std::string& cache_dir,
+                       const std::string& dataset_file,
+                       const std::string& tokenizer_file,
+                       const std::string& options) {
+  std::stringstream key;
+  key << dataset_file << "|" << FileStamp(dataset_file) << "|" << std::hex
+      << ContentHash(tokenizer_file) << "|" << options;
+  key_ = key.str();
+
+  std::stringstream path;
+  path << cache_dir << "/" << std::hex << std::setw(16) << std::setfill('0')
+       << std::hash<std::string>()(key_) << ".tokens";
+  path_ = path.str();
+}
+
+bool TokenCache::Load(std::vector<std::vector<int>>* tokens,
+                      std::vector<int32_t>* metadata) const {
+  std::error_code ec;
+  uint64_t file_size = std::filesystem::file_size(path_, ec);
+  std::ifstream in(path_, std::ios::binary);
+  if (ec || !in) return false;
+
+  char magic[sizeof(kMagic)];
+  uint64_t key_size = 0;
+  if (!in.read(magic, sizeof(magic)) ||
+      std::memcmp(magic, kMagic, sizeof(kMagic)) != 0 ||
+      !Read(in, &key_size) || key_size != key_.size()) {
+    return false;
+  }
+  std::string key(key_size, '\0');
+  uint64_t count = 0;
+  if (!in.read(key.data(), key_size) || key != key_ || !Read(in, &count)) {
+    return false;
+  }
+
+  // Sizes are checked against the bytes left in the file before allocating,
+  // so a truncated or corrupted cache is rejected instead of exhausting
+  // memory.
+  uint64_t remaining = file_size - static_cast<uint64_t>(in.tellg());
+  if (count > remaining / (sizeof(int32_t) + sizeof(uint32_t))) return false;
+  remaining -= count * (sizeof(int32_t) + sizeof(uint32_t));
+
+  tokens->assign(count, {});
+  metadata->assign(count, 0);
+  for (uint64_t i = 0; i < count; ++i) {
+    uint32_t size = 0;
+    if (!Read(in, &(*metadata)[i]) || !Read(in, &size)) return false;
+    if (size > remaining / sizeof(int)) return false;
+    remaining -= size * sizeof(int);
+    (*tokens)[i].resize(size);
+    if (!in.read(reinterpret_cast<char*>((*tokens)[i].data()),
+                 size * sizeof(int))) {
+      return false;
+    }
+  }
+  LOG(INFO) << "Loaded " << count << " tokenized prompts from " << path_;
+  return true;
+}
+
+bool TokenCache::Save(const std::vector<std::vector<int>>& tokens,
+                      const std::vector<int32_t>& metadata) const {
+  // Written to a temporary file first, so an interrupted run never leaves a
+  // partial cache behind.
+  std::string temp_path = path_ + ".tmp";
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    out.write(kMagic, sizeof(kMagic));
+    Write(out, static_cast<uint64_t>(key_.size()));
+    out.write(key_.data(), key_.size());
+    Write(out, static_cast<uint64_t>(tokens.size()));
+    for (size_t i = 0; i < tokens.size(); ++i) {
+      Write(out, metadata[i]);
+      Write(out, static_cast<uint32_t>(tokens[i].size()));
+      out.write(reinterpret_cast<const char*>(tokens[i].data()),
+                tokens[i].size() * sizeof(int));
+    }
+    if (!out) {
+      LOG(ERROR) << "Failed to write token cache " << temp_path;
+      return false;
+    }
+  }
+  if (std::rename(temp_path.c_str(), path_.c_str()) != 0) {
+    LOG(ERROR) << "Failed to write token cache " << path_;
+    return false;
+  }
+  return true;
+}
+
+}  // namespace mobile
+}  // namespace mlperf
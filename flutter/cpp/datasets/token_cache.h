@@ -0,0 +1,51 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef MLPERF_DATASETS_TOKEN_CACHE_H_
+#define MLPERF_DATASETS_TOKEN_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mlperf {
+namespace mobile {
+
+// TokenCache stores the tokenized prompts of an LLM dataset in a file, so
+// later runs with the same tokenizer and dataset skip tokenization. Every
+// prompt is stored with an int32 value for dataset specific metadata.
+class TokenCache {
+ public:
+  // The key covers the content of the tokenizer model, the dataset file and
+  // options, which should describe everything else changing the tokens.
+  TokenCache(const std::string& cache_dir, const std::string& dataset_file,
+             const std::string& tokenizer_file, const std::string& options);
+
+  // Reads the cached prompts. Returns false if there are none for the key.
+  bool Load(std::vector<std::vector<int>>* tokens,
+            std::vector<int32_t>* metadata) const;
+
+  // Replaces the cached prompts. Returns false if they cannot be written.
+  bool Save(const std::vector<std::vector<int>>& tokens,
+            const std::vector<int32_t>& metadata) const;
+
+ private:
+  std::string path_;
+  std::string key_;
+};
+
+}  // namespace mobile
+}  // namespace mlperf
+
+#endif  // MLPERF_DATASETS_TOKEN_CACHE_H_
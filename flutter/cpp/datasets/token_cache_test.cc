@@ -0,0 +1,145 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "flutter/cpp/datasets/token_cache.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace mlperf {
+namespace mobile {
+namespace {
+
+const std::vector<std::vector<int>> kTokens = {{1, 2, 3}, {}, {42}};
+const std::vector<int32_t> kMetadata = {0, 7, -1};
+
+// A fresh cache directory with a dataset and a tokenizer file.
+class TokenCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    dir_ = ::testing::TempDir() + "/token_cache_test_" +
+           ::testing::UnitTest::GetInstance()->current_test_info()->name();
+    std::filesystem::remove_all(dir_);
+    std::filesystem::create_directories(dir_);
+    dataset_ = dir_ + "/dataset.tfrecord";
+    tokenizer_ = dir_ + "/tokenizer.model";
+    std::ofstream(dataset_) << "dataset";
+    std::ofstream(tokenizer_) << "tokenizer";
+  }
+
+  TokenCache Cache(const std::string& options = "options") const {
+    return TokenCache(dir_, dataset_, tokenizer_, options);
+  }
+
+  // The single cache file written to the directory.
+  std::string CacheFile() const {
+    for (const auto& entry : std::filesystem::directory_iterator(dir_)) {
+      if (entry.path().extension() == ".tokens") return entry.path().string();
+    }
+    return "";
+  }
+
+  std::string dir_;
+  std::string dataset_;
+  std::string tokenizer_;
+};
+
+TEST_F(TokenCacheTest, LoadsSavedTokens) {
+  std::vector<std::vector<int>> tokens;
+  std::vector<int32_t> metadata;
+  EXPECT_FALSE(Cache().Load(&tokens, &metadata));
+
+  ASSERT_TRUE(Cache().Save(kTokens, kMetadata));
+  ASSERT_TRUE(Cache().Load(&tokens, &metadata));
+  EXPECT_EQ(tokens, kTokens);
+  EXPECT_EQ(metadata, kMetadata);
+}
+
+TEST_F(TokenCacheTest, MissesOnOtherOptions) {
+  ASSERT_TRUE(Cache("zero_shot").Save(kTokens, kMetadata));
+  std::vector<std::vector<int>> tokens;
+  std::vector<int32_t> metadata;
+  EXPECT_FALSE(Cache("few_shot").Load(&tokens, &metadata));
+}
+
+TEST_F(TokenCacheTest, MissesOnChangedDataset) {
+  ASSERT_TRUE(Cache().Save(kTokens, kMetadata));
+  // Another size gives another key, whatever the modification time.
+  std::ofstream(dataset_) << "another dataset";
+  std::vector<std::vector<int>> tokens;
+  std::vector<int32_t> metadata;
+  EXPECT_FALSE(Cache().Load(&tokens, &metadata));
+}
+
+TEST_F(TokenCacheTest, MissesOnChangedTokenizer) {
+  ASSERT_TRUE(Cache().Save(kTokens, kMetadata));
+  std::ofstream(tokenizer_) << "another tokenizer";
+  std::vector<std::vector<int>> tokens;
+  std::vector<int32_t> metadata;
+  EXPECT_FALSE(Cache().Load(&tokens, &metadata));
+}
+
+TEST_F(TokenCacheTest, RejectsSizesBeyondFile) {
+  ASSERT_TRUE(Cache().Save(kTokens, kMetadata));
+  const std::string path = CacheFile();
+  ASSERT_FALSE(path.empty());
+
+  // The prompt count follows the magic, the key size and the key.
+  uint64_t key_size = 0;
+  {
+    std::ifstream in(path, std::ios::binary);
+    in.seekg(8);
+    in.read(reinterpret_cast<char*>(&key_size), sizeof(key_size));
+  }
+  const std::streamoff count_offset = 16 + key_size;
+  std::vector<std::vector<int>> tokens;
+  std::vector<int32_t> metadata;
+
+  {
+    std::fstream out(path, std::ios::binary | std::ios::in | std::ios::out);
+    out.seekp(count_offset);
+    const uint64_t count = uint64_t{1} << 60;
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  }
+  EXPECT_FALSE(Cache().Load(&tokens, &metadata));
+
+  // A valid count with an oversized first prompt.
+  ASSERT_TRUE(Cache().Save(kTokens, kMetadata));
+  {
+    std::fstream out(path, std::ios::binary | std::ios::in | std::ios::out);
+    out.seekp(count_offset + sizeof(uint64_t) + sizeof(int32_t));
+    const uint32_t size = 0xffffffff;
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+  }
+  EXPECT_FALSE(Cache().Load(&tokens, &metadata));
+
+  // A truncated file.
+  ASSERT_TRUE(Cache().Save(kTokens, kMetadata));
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+  EXPECT_FALSE(Cache().Load(&tokens, &metadata));
+}
+
+}  // namespace
+}  // namespace mobile
+}  // namespace mlperf
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -50,6 +50,7 @@ struct dart_ffi_run_benchmark_out* dart_ffi_run_benchmark(
   lin(min_duration);
   lin(max_duration);
   lin(single_stream_expected_latency_ns);
+  lin(server_target_qps);
   lin(output_dir);
 
   li;
@@ -153,7 +154,8 @@ struct dart_ffi_run_benchmark_out* dart_ffi_run_benchmark(
   auto start = std::chrono::steady_clock::now();
   driver.RunMLPerfTest(in->mode, in->min_query_count, in->min_duration,
                        in->max_duration, in->single_stream_expected_latency_ns,
-                       in->output_dir, use_token_latencies);
+                       in->output_dir, use_token_latencies,
+                       in->server_target_qps);
   auto end = std::chrono::steady_clock::now();
   li;
 
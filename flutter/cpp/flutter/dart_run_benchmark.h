@@ -27,6 +27,7 @@ struct dart_ffi_run_benchmark_in {
   double min_duration;
   double max_duration;
   int32_t single_stream_expected_latency_ns;
+  double server_target_qps;
   const char *output_dir;
 };
 
@@ -13,8 +13,14 @@ limitations under the License.
 
 #include <stdint.h>
 
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "flutter/cpp/backend.h"
@@ -28,6 +34,9 @@ limitations under the License.
 namespace mlperf {
 namespace mobile {
 
+// Enough for the timestamps of any query of the token based benchmarks.
+static constexpr int kMaxTokenTimestamps = 1 << 16;
+
 // A method to be called by the backend as soon as the first token is generated
 // (only for token based benchmarks)
 static void FirstTokenCallback(void* context) {
@@ -36,13 +45,217 @@ static void FirstTokenCallback(void* context) {
   ::mlperf::FirstTokenComplete(ft_responses.data(), ft_responses.size());
 }
 
+// Holds the response payloads of one batch until they are reported to loadgen.
+// The storage is kept between batches, so the memory used for responses is
+// bounded by the batch size instead of the query size.
+class ResponseArena {
+ public:
+  explicit ResponseArena(size_t capacity) : data_(capacity) {
+    responses_.reserve(capacity);
+  }
+
+  void Add(::mlperf::ResponseId id, const std::vector<uint8_t>& payload) {
+    std::vector<uint8_t>& data = NextSlot();
+    data.assign(payload.begin(), payload.end());
+    responses_.push_back(
+        {id, reinterpret_cast<std::uintptr_t>(data.data()), data.size()});
+  }
+
+  void Add(::mlperf::ResponseId id, const std::vector<uint8_t>& payload,
+           int64_t n_tokens) {
+    std::vector<uint8_t>& data = NextSlot();
+    data.assign(payload.begin(), payload.end());
+    responses_.push_back({id, reinterpret_cast<std::uintptr_t>(data.data()),
+                          data.size(), n_tokens});
+  }
+
+  // Reports the stored responses to loadgen and recycles their storage.
+  void Complete() {
+    if (responses_.empty()) return;
+    ::mlperf::QuerySamplesComplete(responses_.data(), responses_.size());
+    responses_.clear();
+  }
+
+ private:
+  std::vector<uint8_t>& NextSlot() {
+    if (responses_.size() == data_.size()) data_.emplace_back();
+    return data_[responses_.size()];
+  }
+
+  std::vector<std::vector<uint8_t>> data_;
+  std::vector<::mlperf::QuerySampleResponse> responses_;
+};
+
+bool MlperfDriver::CanPipeline() {
+  // Token based outputs are handed over as pointers to backend owned
+  // containers and cannot be copied by size.
+  if (pipeline_depth_ <= 0 || use_tokens_) return false;
+  for (const auto& output : backend_->GetOutputFormat()) {
+    if (output.size <= 0) return false;
+  }
+  return true;
+}
+
+void MlperfDriver::OutputLoop() {
+  // ProcessOutput runs in sample order on this thread only, so datasets see
+  // the same call sequence as in the serial path. Each batch is reported to
+  // loadgen as soon as its last sample has been processed.
+  ResponseArena arena(UseBatches() ? batch_ : 1);
+  while (true) {
+    PendingOutput job;
+    {
+      std::unique_lock<std::mutex> lock(output_mutex_);
+      output_cv_.wait(lock, [this]() {
+        return output_done_ || !pending_outputs_.empty();
+      });
+      if (pending_outputs_.empty()) return;
+      job = std::move(pending_outputs_.front());
+      pending_outputs_.pop_front();
+    }
+    output_cv_.notify_all();
+
+    std::vector<void*> outputs;
+    for (auto& buffer : job.buffers) outputs.push_back(buffer.data());
+    arena.Add(job.sample.id,
+              dataset_->ProcessOutput(job.sample.index, outputs));
+    if (job.last_in_batch) arena.Complete();
+
+    {
+      std::lock_guard<std::mutex> lock(output_mutex_);
+      free_output_buffers_.push_back(std::move(job.buffers));
+      unreported_outputs_--;
+    }
+    output_cv_.notify_all();
+  }
+}
+
+void MlperfDriver::IssueQueryPipelined(
+    const std::vector<::mlperf::QuerySample>& samples) {
+  const DataFormat& output_format = backend_->GetOutputFormat();
+  const int step = UseBatches() ? batch_ : 1;
+  std::vector<::mlperf::QuerySampleResponse> ft_responses;
+
+  for (int idx = 0; idx < samples.size(); idx += step) {
+    std::vector<::mlperf::QuerySample> sample;
+    for (int b = 0; b < step; b++) {
+      int sample_index = idx + b < samples.size()
+                             ? idx + b
+                             : samples.size() - 1;  // fill the batch
+      sample.emplace_back(samples.at(sample_index));
+      std::vector<void*> inputs = dataset_->GetData(sample.back().index);
+      backend_->SetInputs(inputs, b);
+    }
+
+    ft_responses.clear();
+    ft_responses.push_back(
+        {sample.back().id, reinterpret_cast<std::uintptr_t>(nullptr), 0});
+    backend_->IssueQuery(&FirstTokenCallback,
+                         reinterpret_cast<void*>(&ft_responses));
+
+    for (int b = 0; b < step; b++) {
+      if (idx + b == samples.size()) break;  // ignore extra data
+      PendingOutput job;
+      job.sample = sample[b];
+      job.last_in_batch = b == step - 1 || idx + b + 1 == samples.size();
+      {
+        std::unique_lock<std::mutex> lock(output_mutex_);
+        output_cv_.wait(lock, [this]() {
+          return pending_outputs_.size() <
+                 static_cast<size_t>(pipeline_depth_);
+        });
+        if (!free_output_buffers_.empty()) {
+          job.buffers = std::move(free_output_buffers_.back());
+          free_output_buffers_.pop_back();
+        }
+      }
+
+      // The backend may reuse its output tensors for the next inference, so
+      // snapshot them before handing them to the output thread.
+      std::vector<void*> outputs = backend_->GetPredictedOutputs(b);
+      job.buffers.resize(outputs.size());
+      for (int i = 0; i < outputs.size(); ++i) {
+        size_t bytes = output_format[i].size * GetByte(output_format[i]);
+        job.buffers[i].resize(bytes);
+        std::memcpy(job.buffers[i].data(), outputs[i], bytes);
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(output_mutex_);
+        pending_outputs_.push_back(std::move(job));
+        unreported_outputs_++;
+      }
+      output_cv_.notify_all();
+    }
+    backend_->FlushQueries();
+    query_counter_ += step;
+  }
+
+  // Like the serial path, return once every sample has been reported.
+  std::unique_lock<std::mutex> lock(output_mutex_);
+  output_cv_.wait(lock, [this]() { return unreported_outputs_ == 0; });
+}
+
 void MlperfDriver::IssueQuery(
     const std::vector<::mlperf::QuerySample>& samples) {
-  std::vector<::mlperf::QuerySampleResponse> responses;
+  if (scenario_ == "Server") {
+    // Loadgen issues Server queries from its own thread on a Poisson
+    // schedule, so only queue the samples here and return immediately.
+    {
+      std::lock_guard<std::mutex> lock(server_mutex_);
+      server_queue_.insert(server_queue_.end(), samples.begin(),
+                           samples.end());
+    }
+    server_cv_.notify_one();
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(backend_mutex_);
+  RunSamples(samples);
+}
+
+void MlperfDriver::ServerLoop() {
+  while (true) {
+    std::vector<::mlperf::QuerySample> samples;
+    {
+      std::unique_lock<std::mutex> lock(server_mutex_);
+      server_cv_.wait(
+          lock, [this]() { return server_done_ || !server_queue_.empty(); });
+      if (server_queue_.empty()) return;
+      // Coalesce the queued samples into at most one batch.
+      while (!server_queue_.empty() &&
+             samples.size() < static_cast<size_t>(batch_)) {
+        samples.push_back(server_queue_.front());
+        server_queue_.pop_front();
+      }
+    }
+    std::lock_guard<std::mutex> lock(backend_mutex_);
+    RunSamples(samples);
+  }
+}
+
+void MlperfDriver::RecordTokenLatencies() {
+  int count = backend_->GetTokenTimestamps(
+      token_timestamps_.data(), static_cast<int>(token_timestamps_.size()));
+  token_latency_.AddQuery(token_timestamps_.data(), count);
+  int64_t proposed = 0, accepted = 0;
+  if (backend_->GetDraftTokenCounts(&proposed, &accepted)) {
+    token_latency_.AddDraftTokens(proposed, accepted);
+  }
+}
+
+void MlperfDriver::RunSamples(
+    const std::vector<::mlperf::QuerySample>& samples) {
+  if (CanPipeline()) {
+    IssueQueryPipelined(samples);
+    return;
+  }
+
   std::vector<::mlperf::QuerySampleResponse> ft_responses;
-  std::vector<std::vector<uint8_t>> response_data;
 
-  if (scenario_ == "Offline") {
+  if (UseBatches()) {
+    // Each batch is reported to loadgen as soon as it is processed, so its
+    // response storage can be reused by the next batch.
+    ResponseArena arena(batch_);
     for (int idx = 0; idx < samples.size(); idx += batch_) {
       std::vector<::mlperf::QuerySample> sample;
       for (int b = 0; b < batch_; b++) {
@@ -63,62 +276,62 @@ void MlperfDriver::IssueQuery(
 
       backend_->IssueQuery(&FirstTokenCallback,
                            reinterpret_cast<void*>(&ft_responses));
+      if (use_tokens_) RecordTokenLatencies();
 
       for (int b = 0; b < batch_; b++) {
         if (idx + b == samples.size()) break;  // ignore extra data
         // Report to mlperf.
         std::vector<void*> outputs = backend_->GetPredictedOutputs(b);
-        response_data.push_back(
-            dataset_->ProcessOutput(sample[b].index, outputs));
-        responses.push_back(
-            {sample[b].id,
-             reinterpret_cast<std::uintptr_t>(response_data[idx + b].data()),
-             response_data[idx + b].size()});
+        if (use_tokens_) {
+          arena.Add(sample[b].id,
+                    dataset_->ProcessOutput(sample[b].index, outputs),
+                    dataset_->GetOutputTokenCount(sample[b].index));
+        } else {
+          arena.Add(sample[b].id,
+                    dataset_->ProcessOutput(sample[b].index, outputs));
+        }
       }
       backend_->FlushQueries();
       query_counter_ += batch_;
+      arena.Complete();
     }
-  } else {
-    for (int idx = 0; idx < samples.size(); ++idx) {
-      ::mlperf::QuerySample sample = samples.at(idx);
-      std::vector<void*> inputs = dataset_->GetData(sample.index);
-      backend_->SetInputs(inputs);
+    return;
+  }
 
-      // TODO maybe don't do these 2 lines for non token stuff
-      ft_responses.clear();
-      ft_responses.push_back(
-          {sample.id, reinterpret_cast<std::uintptr_t>(nullptr), 0});
+  ResponseArena arena(samples.size());
+  for (int idx = 0; idx < samples.size(); ++idx) {
+    ::mlperf::QuerySample sample = samples.at(idx);
+    std::vector<void*> inputs = dataset_->GetData(sample.index);
+    backend_->SetInputs(inputs);
 
-      backend_->IssueQuery(&FirstTokenCallback,
-                           reinterpret_cast<void*>(&ft_responses));
+    // TODO maybe don't do these 2 lines for non token stuff
+    ft_responses.clear();
+    ft_responses.push_back(
+        {sample.id, reinterpret_cast<std::uintptr_t>(nullptr), 0});
 
-      // Report to mlperf.
-      std::vector<void*> outputs = backend_->GetPredictedOutputs();
-      response_data.push_back(dataset_->ProcessOutput(sample.index, outputs));
-      if (use_tokens_) {
-        responses.push_back(
-            {sample.id,
-             reinterpret_cast<std::uintptr_t>(response_data[idx].data()),
-             response_data[idx].size(),
-             dataset_->GetOutputTokenCount(sample.index)});
-      } else {
-        responses.push_back(
-            {sample.id,
-             reinterpret_cast<std::uintptr_t>(response_data[idx].data()),
-             response_data[idx].size()});
-      }
-      backend_->FlushQueries();
-      query_counter_ += 1;
+    backend_->IssueQuery(&FirstTokenCallback,
+                         reinterpret_cast<void*>(&ft_responses));
+
+    // Report to mlperf.
+    std::vector<void*> outputs = backend_->GetPredictedOutputs();
+    if (use_tokens_) {
+      RecordTokenLatencies();
+      arena.Add(sample.id, dataset_->ProcessOutput(sample.index, outputs),
+                dataset_->GetOutputTokenCount(sample.index));
+    } else {
+      arena.Add(sample.id, dataset_->ProcessOutput(sample.index, outputs));
     }
+    backend_->FlushQueries();
+    query_counter_ += 1;
   }
-  ::mlperf::QuerySamplesComplete(responses.data(), responses.size());
+  arena.Complete();
 }
 
 void MlperfDriver::RunMLPerfTest(const std::string& mode, int min_query_count,
                                  double min_duration, double max_duration,
                                  int single_stream_expected_latency_ns,
                                  const std::string& output_dir,
-                                 bool use_tokens) {
+                                 bool use_tokens, double server_target_qps) {
   ::mlperf::LogSettings log_settings;
   log_settings.log_output.outdir = output_dir;
   log_settings.log_output.copy_summary_to_stdout = true;
@@ -133,7 +346,8 @@ void MlperfDriver::RunMLPerfTest(const std::string& mode, int min_query_count,
   mlperf_settings.min_query_count = min_query_count;
   use_tokens_ = use_tokens;
   mlperf_settings.use_token_latencies = use_tokens;
-  // mlperf_settings.server_target_qps = 0.1;
+  token_latency_.Reset();
+  if (use_tokens) token_timestamps_.resize(kMaxTokenTimestamps);
 
   // Prevent datasets with performance sample count 0 from running.
   // This function isn't expected to see a Submission run mode, only Accuracy
@@ -154,6 +368,19 @@ void MlperfDriver::RunMLPerfTest(const std::string& mode, int min_query_count,
 
   if (scenario_ == "Offline") {
     mlperf_settings.scenario = ::mlperf::TestScenario::Offline;
+  } else if (scenario_ == "Server") {
+    mlperf_settings.scenario = ::mlperf::TestScenario::Server;
+    if (server_target_qps > 0) {
+      mlperf_settings.server_target_qps = server_target_qps;
+    } else {
+      LOG(ERROR) << "server_target_qps is not set, using the loadgen default "
+                 << mlperf_settings.server_target_qps;
+    }
+  } else if (scenario_ == "MultiStream") {
+    mlperf_settings.scenario = ::mlperf::TestScenario::MultiStream;
+    // Used as a hint for the latency of a whole query.
+    mlperf_settings.multi_stream_expected_latency_ns =
+        single_stream_expected_latency_ns;
   } else {
     // Run MLPerf in SingleStream mode by default.
     mlperf_settings.scenario = ::mlperf::TestScenario::SingleStream;
@@ -161,7 +388,45 @@ void MlperfDriver::RunMLPerfTest(const std::string& mode, int min_query_count,
         single_stream_expected_latency_ns;
   }
 
+  if (scenario_ == "Server") {
+    server_done_ = false;
+    server_thread_ = std::thread(&MlperfDriver::ServerLoop, this);
+  }
+  if (CanPipeline()) {
+    output_done_ = false;
+    output_thread_ = std::thread(&MlperfDriver::OutputLoop, this);
+  }
+
   ::mlperf::StartTest(this, dataset_.get(), mlperf_settings, log_settings);
+
+  if (server_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(server_mutex_);
+      server_done_ = true;
+    }
+    server_cv_.notify_one();
+    server_thread_.join();
+  }
+  // Stopped after the server thread, which may still wait for its outputs.
+  if (output_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(output_mutex_);
+      output_done_ = true;
+    }
+    output_cv_.notify_all();
+    output_thread_.join();
+  }
+
+  if (!token_latency_.Empty()) {
+    std::string summary = token_latency_.Summary();
+    LOG(INFO) << summary;
+    std::ofstream file(output_dir + "/mlperf_log_token_latency.txt");
+    file << summary;
+    if (!file) {
+      LOG(ERROR) << "Failed to write the token latency summary to "
+                 << output_dir;
+    }
+  }
 }
 
 }  // namespace mobile
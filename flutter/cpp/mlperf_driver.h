@@ -16,14 +16,20 @@ limitations under the License.
 #include <stdint.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <iomanip>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "flutter/cpp/backend.h"
 #include "flutter/cpp/dataset.h"
+#include "flutter/cpp/token_latency.h"
 #include "loadgen/system_under_test.h"
 
 namespace mlperf {
@@ -34,24 +40,31 @@ class MlperfDriver : public ::mlperf::SystemUnderTest {
  public:
   MlperfDriver(std::unique_ptr<Dataset> dataset,
                std::unique_ptr<Backend> backend, const std::string& scenario,
-               int batch)
+               int batch, int pipeline_depth = 0)
       : dataset_(std::move(dataset)),
         backend_(std::move(backend)),
         scenario_(scenario),
-        batch_(batch) {}
+        batch_(batch),
+        pipeline_depth_(pipeline_depth) {}
 
-  ~MlperfDriver() override {}
+  // Datasets may register a token callback on the backend, so it is cleared
+  // before the backend is released. Datasets are destroyed after the backend
+  // and must not use it in their destructors.
+  ~MlperfDriver() override { backend_->SetTokenCallback(nullptr, nullptr); }
 
   // Runs MLPerf tests.
   void RunMLPerfTest(const std::string& mode, int min_query_count,
                      double min_duration, double max_duration,
                      int single_stream_expected_latency_ns,
-                     const std::string& output_dir, bool use_tokens = false);
+                     const std::string& output_dir, bool use_tokens = false,
+                     double server_target_qps = 0);
 
   // A human-readable string for logging purposes.
   const std::string& Name() override { return backend_->Name(); }
 
-  // Run N samples generated by loadgen. This function blocks until completion.
+  // Run N samples generated by loadgen. This function blocks until completion,
+  // except in the Server scenario where samples are queued and run by a
+  // separate thread. It is safe to call from multiple threads.
   void IssueQuery(const std::vector<::mlperf::QuerySample>& samples) override;
 
   // Flush the staged queries immediately.
@@ -71,13 +84,75 @@ class MlperfDriver : public ::mlperf::SystemUnderTest {
   int32_t GetCounter() { return query_counter_.load(); }
 
  private:
+  // Scenarios other than SingleStream run samples in batches of batch_.
+  bool UseBatches() const { return scenario_ != "SingleStream"; }
+
+  // Runs the samples on the backend and reports them to loadgen. Must be
+  // called with backend_mutex_ held.
+  void RunSamples(const std::vector<::mlperf::QuerySample>& samples);
+
+  // Runs queued Server samples until server_done_ is set.
+  void ServerLoop();
+
+  // Adds the token timestamps and draft token counts of the last query to
+  // token_latency_.
+  void RecordTokenLatencies();
+
+  // Returns true if the backend outputs can be snapshotted so that
+  // post-processing can run on a worker thread.
+  bool CanPipeline();
+
+  // Runs the samples with post-processing overlapped with inference. At most
+  // pipeline_depth_ outputs are waiting for ProcessOutput at any time.
+  void IssueQueryPipelined(const std::vector<::mlperf::QuerySample>& samples);
+
+  // Runs ProcessOutput on pending outputs until output_done_ is set.
+  void OutputLoop();
+
+  // Destroyed in reverse order, so dataset_ outlives backend_.
   std::unique_ptr<Dataset> dataset_;
   std::unique_ptr<Backend> backend_;
-  // Offline or SingleStream scenario.
+  // SingleStream, Offline, Server or MultiStream scenario.
   std::string scenario_;
   int batch_;
+  // Maximum number of outputs pending post-processing. 0 disables pipelining.
+  int pipeline_depth_;
   std::atomic<int32_t> query_counter_{0};
   bool use_tokens_;
+
+  // Per-token latencies of token based benchmarks, written next to the
+  // loadgen logs. The timestamp buffer is allocated once per test.
+  TokenLatencyStats token_latency_;
+  std::vector<int64_t> token_timestamps_;
+
+  // Serializes access to the backend, which handles one query at a time.
+  std::mutex backend_mutex_;
+
+  // Samples issued in the Server scenario, waiting for the server thread.
+  std::mutex server_mutex_;
+  std::condition_variable server_cv_;
+  std::deque<::mlperf::QuerySample> server_queue_;
+  bool server_done_ = false;
+  std::thread server_thread_;
+
+  // An inference result copied out of the backend, waiting for ProcessOutput.
+  struct PendingOutput {
+    ::mlperf::QuerySample sample;
+    bool last_in_batch;
+    std::vector<std::vector<uint8_t>> buffers;
+  };
+  // Outputs of the pipelined path. They are processed by one output thread
+  // that runs for the whole test, so queries do not start a thread each.
+  std::mutex output_mutex_;
+  std::condition_variable output_cv_;
+  std::deque<PendingOutput> pending_outputs_;
+  // Output buffers returned by the output thread, reused to avoid
+  // reallocation.
+  std::vector<std::vector<std::vector<uint8_t>>> free_output_buffers_;
+  // Outputs queued and not reported to loadgen yet.
+  size_t unreported_outputs_ = 0;
+  bool output_done_ = false;
+  std::thread output_thread_;
 };
 
 }  // namespace mobile
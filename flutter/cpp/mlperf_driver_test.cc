@@ -0,0 +1,110 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "flutter/cpp/mlperf_driver.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flutter/cpp/backend.h"
+#include "flutter/cpp/dataset.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace mlperf {
+namespace mobile {
+namespace {
+
+using ::testing::ElementsAre;
+
+// A streaming backend logging its token callback and its destruction.
+class FakeBackend : public Backend {
+ public:
+  explicit FakeBackend(std::vector<std::string>* events) : events_(events) {}
+
+  ~FakeBackend() override { events_->push_back("backend destroyed"); }
+
+  const std::string& Name() const override { return name_; }
+  const std::string& Vendor() const override { return name_; }
+  const std::string& AcceleratorName() const override { return name_; }
+  void IssueQuery(ft_callback callback, void* context) override {
+    callback(context);
+  }
+  void FlushQueries() override {}
+  void SetInputs(const std::vector<void*>&, int) override {}
+  std::vector<void*> GetPredictedOutputs(int) override { return {}; }
+  const DataFormat& GetInputFormat() override { return format_; }
+  const DataFormat& GetOutputFormat() override { return format_; }
+  void ConvertInputs(int, int, int, uint8_t*) override {}
+  void ConvertOutputs(int, int, int, uint8_t*) override {}
+
+  bool SetTokenCallback(token_callback callback, void*) override {
+    events_->push_back(callback ? "callback set" : "callback cleared");
+    return true;
+  }
+
+ private:
+  std::vector<std::string>* events_;
+  const std::string name_ = "FakeBackend";
+  const DataFormat format_ = {{DataType::Int32, 1}};
+};
+
+// A dataset registering a token callback like MmluGen with early stop.
+class EarlyStopDataset : public Dataset {
+ public:
+  EarlyStopDataset(Backend* backend, std::vector<std::string>* events)
+      : Dataset(backend), events_(events) {
+    backend_->SetTokenCallback(&EarlyStopDataset::OnToken, this);
+  }
+
+  ~EarlyStopDataset() override { events_->push_back("dataset destroyed"); }
+
+  const std::string& Name() override { return name_; }
+  size_t TotalSampleCount() override { return 1; }
+  void LoadSamplesToRam(const std::vector<QuerySampleIndex>&) override {}
+  void UnloadSamplesFromRam(const std::vector<QuerySampleIndex>&) override {}
+  std::vector<void*> GetData(int) override { return {}; }
+  std::vector<uint8_t> ProcessOutput(const int,
+                                     const std::vector<void*>&) override {
+    return {};
+  }
+
+ private:
+  static bool OnToken(void*, int32_t, int32_t) { return true; }
+
+  std::vector<std::string>* events_;
+  const std::string name_ = "EarlyStopDataset";
+};
+
+TEST(MlperfDriver, ClearsTokenCallbackBeforeReleasingBackend) {
+  std::vector<std::string> events;
+  {
+    auto backend = std::make_unique<FakeBackend>(&events);
+    auto dataset = std::make_unique<EarlyStopDataset>(backend.get(), &events);
+    MlperfDriver driver(std::move(dataset), std::move(backend), "Offline", 1);
+  }
+  EXPECT_THAT(events,
+              ElementsAre("callback set", "callback cleared",
+                          "backend destroyed", "dataset destroyed"));
+}
+
+}  // namespace
+}  // namespace mobile
+}  // namespace mlperf
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
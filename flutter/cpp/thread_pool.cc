@@ -0,0 +1,84 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "flutter/cpp/thread_pool.h"
+
+#include <algorithm>
+
+namespace mlperf {
+namespace mobile {
+
+ThreadPool::ThreadPool(int num_threads) {
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (int i = 0; i < num_threads; ++i) {
+    threads_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (std::thread& thread : threads_) thread.join();
+}
+
+void ThreadPool::ParallelFor(size_t count,
+                             const std::function<void(size_t, int)>& fn) {
+  if (count == 0) return;
+  std::lock_guard<std::mutex> call_lock(call_mutex_);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  fn_ = &fn;
+  count_ = count;
+  next_ = 0;
+  active_ = NumThreads();
+  ++generation_;
+  work_cv_.notify_all();
+  done_cv_.wait(lock, [this]() { return active_ == 0; });
+  fn_ = nullptr;
+}
+
+void ThreadPool::WorkerLoop(int thread_id) {
+  uint64_t seen_generation = 0;
+  while (true) {
+    const std::function<void(size_t, int)>* fn;
+    size_t count;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cv_.wait(lock, [&]() {
+        return stop_ || generation_ != seen_generation;
+      });
+      if (stop_) return;
+      seen_generation = generation_;
+      fn = fn_;
+      count = count_;
+    }
+
+    // Indices are handed out one at a time so that uneven work items, such
+    // as images of different sizes, are balanced across workers.
+    for (size_t i = next_++; i < count; i = next_++) {
+      (*fn)(i, thread_id);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--active_ == 0) done_cv_.notify_all();
+  }
+}
+
+}  // namespace mobile
+}  // namespace mlperf
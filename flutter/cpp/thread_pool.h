@@ -0,0 +1,68 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef MLPERF_THREAD_POOL_H_
+#define MLPERF_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mlperf {
+namespace mobile {
+
+// ThreadPool keeps a fixed set of worker threads to run loops in parallel.
+class ThreadPool {
+ public:
+  // Creates num_threads workers. A non-positive value uses one worker per
+  // hardware thread.
+  explicit ThreadPool(int num_threads);
+
+  ~ThreadPool();
+
+  int NumThreads() const { return static_cast<int>(threads_.size()); }
+
+  // Calls fn(index, thread_id) for every index in [0, count) and blocks until
+  // all calls returned. thread_id is in [0, NumThreads()) and identifies the
+  // worker, so callers can keep per-worker state.
+  void ParallelFor(size_t count,
+                   const std::function<void(size_t, int)>& fn);
+
+ private:
+  void WorkerLoop(int thread_id);
+
+  std::vector<std::thread> threads_;
+  // Serializes concurrent ParallelFor calls.
+  std::mutex call_mutex_;
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  const std::function<void(size_t, int)>* fn_ = nullptr;
+  size_t count_ = 0;
+  std::atomic<size_t> next_{0};
+  int active_ = 0;
+  uint64_t generation_ = 0;
+  bool stop_ = false;
+};
+
+}  // namespace mobile
+}  // namespace mlperf
+
+#endif  // MLPERF_THREAD_POOL_H_
@@ -0,0 +1,62 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "thread_pool.h"
+
+#include <atomic>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace mlperf {
+namespace mobile {
+namespace {
+
+using ::testing::Each;
+
+TEST(ThreadPool, VisitsEveryIndexOnce) {
+  ThreadPool pool(4);
+  std::vector<std::atomic<int>> visits(1000);
+  pool.ParallelFor(visits.size(), [&](size_t i, int) { visits[i]++; });
+  std::vector<int> counts(visits.begin(), visits.end());
+  EXPECT_THAT(counts, Each(1));
+}
+
+TEST(ThreadPool, ThreadIdInRange) {
+  ThreadPool pool(3);
+  std::atomic<bool> in_range{true};
+  pool.ParallelFor(100, [&](size_t, int thread_id) {
+    if (thread_id < 0 || thread_id >= pool.NumThreads()) in_range = false;
+  });
+  EXPECT_TRUE(in_range);
+}
+
+TEST(ThreadPool, Reusable) {
+  ThreadPool pool(2);
+  std::atomic<int> sum{0};
+  for (int round = 0; round < 10; ++round) {
+    pool.ParallelFor(10, [&](size_t i, int) { sum += i; });
+  }
+  EXPECT_EQ(sum, 450);
+}
+
+}  // namespace
+}  // namespace mobile
+}  // namespace mlperf
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
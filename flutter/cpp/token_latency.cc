@@ -0,0 +1,141 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "flutter/cpp/token_latency.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace mlperf {
+namespace mobile {
+
+namespace {
+
+// Bucket i holds latencies in [kMinLatencyNs * kGrowth^i,
+// kMinLatencyNs * kGrowth^(i+1)). 1100 buckets reach about 45 minutes.
+constexpr double kMinLatencyNs = 1000.0;
+constexpr double kGrowth = 1.02;
+constexpr int kNumBuckets = 1100;
+
+int BucketIndex(int64_t latency_ns) {
+  if (latency_ns <= kMinLatencyNs) return 0;
+  int index = static_cast<int>(std::log(latency_ns / kMinLatencyNs) /
+                               std::log(kGrowth));
+  return std::min(index, kNumBuckets - 1);
+}
+
+double ToMs(double ns) { return ns / 1e6; }
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : buckets_(kNumBuckets, 0) {}
+
+void LatencyHistogram::Add(int64_t latency_ns) {
+  latency_ns = std::max<int64_t>(latency_ns, 0);
+  buckets_[BucketIndex(latency_ns)]++;
+  count_++;
+  sum_ns_ += latency_ns;
+  max_ns_ = std::max(max_ns_, latency_ns);
+}
+
+void LatencyHistogram::Reset() {
+  std::fill(buckets_.begin(), buckets_.end(), 0);
+  count_ = 0;
+  sum_ns_ = 0.0;
+  max_ns_ = 0;
+}
+
+int64_t LatencyHistogram::Percentile(double p) const {
+  if (count_ == 0) return 0;
+  uint64_t rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(p * static_cast<double>(count_))));
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumBuckets; ++i) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      // The geometric middle of the bucket, capped by the largest value.
+      double middle = kMinLatencyNs * std::pow(kGrowth, i + 0.5);
+      return std::min(static_cast<int64_t>(middle), max_ns_);
+    }
+  }
+  return max_ns_;
+}
+
+void TokenLatencyStats::AddQuery(const int64_t* timestamps_ns, int count) {
+  if (count < 2) return;
+  queries_++;
+  output_tokens_ += count - 1;
+  ttft_.Add(timestamps_ns[1] - timestamps_ns[0]);
+  for (int i = 2; i < count; ++i) {
+    inter_token_.Add(timestamps_ns[i] - timestamps_ns[i - 1]);
+  }
+  if (count > 2) {
+    decode_ns_ += timestamps_ns[count - 1] - timestamps_ns[1];
+    decode_tokens_ += count - 2;
+  }
+}
+
+void TokenLatencyStats::AddDraftTokens(int64_t proposed, int64_t accepted) {
+  draft_proposed_ += std::max<int64_t>(proposed, 0);
+  draft_accepted_ += std::max<int64_t>(accepted, 0);
+}
+
+void TokenLatencyStats::Reset() {
+  queries_ = 0;
+  output_tokens_ = 0;
+  ttft_.Reset();
+  inter_token_.Reset();
+  decode_ns_ = 0.0;
+  decode_tokens_ = 0;
+  draft_proposed_ = 0;
+  draft_accepted_ = 0;
+}
+
+std::string TokenLatencyStats::Summary() const {
+  std::ostringstream out;
+  out << "================================================\n"
+      << "Token latency summary\n"
+      << "================================================\n"
+      << "Queries : " << queries_ << "\n"
+      << "Output tokens : " << output_tokens_ << "\n\n"
+      << "Mean TTFT (ms) : " << ToMs(ttft_.Mean()) << "\n"
+      << "50.00 percentile TTFT (ms) : " << ToMs(ttft_.Percentile(0.5))
+      << "\n"
+      << "90.00 percentile TTFT (ms) : " << ToMs(ttft_.Percentile(0.9))
+      << "\n"
+      << "99.00 percentile TTFT (ms) : " << ToMs(ttft_.Percentile(0.99))
+      << "\n\n"
+      << "Mean TPOT (ms) : "
+      << ToMs(decode_tokens_ ? decode_ns_ / decode_tokens_ : 0.0) << "\n"
+      << "50.00 percentile inter-token latency (ms) : "
+      << ToMs(inter_token_.Percentile(0.5)) << "\n"
+      << "90.00 percentile inter-token latency (ms) : "
+      << ToMs(inter_token_.Percentile(0.9)) << "\n"
+      << "99.00 percentile inter-token latency (ms) : "
+      << ToMs(inter_token_.Percentile(0.99)) << "\n"
+      << "Max inter-token latency (ms) : " << ToMs(inter_token_.Max())
+      << "\n";
+  if (draft_proposed_ > 0) {
+    out << "\n"
+        << "Draft tokens proposed : " << draft_proposed_ << "\n"
+        << "Draft tokens accepted : " << draft_accepted_ << "\n"
+        << "Draft acceptance rate (%) : "
+        << 100.0 * draft_accepted_ / draft_proposed_ << "\n";
+  }
+  return out.str();
+}
+
+}  // namespace mobile
+}  // namespace mlperf
@@ -0,0 +1,80 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef MLPERF_TOKEN_LATENCY_H_
+#define MLPERF_TOKEN_LATENCY_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace mlperf {
+namespace mobile {
+
+// Log-scale latency histogram with fixed memory. Buckets are 2% wide, so
+// percentiles are within 1% of the recorded values.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  void Add(int64_t latency_ns);
+  void Reset();
+
+  uint64_t Count() const { return count_; }
+  int64_t Max() const { return max_ns_; }
+  double Mean() const { return count_ ? sum_ns_ / count_ : 0.0; }
+  // Latency below which the fraction p of the values fall, p in [0, 1].
+  int64_t Percentile(double p) const;
+
+ private:
+  std::vector<uint64_t> buckets_;
+  uint64_t count_ = 0;
+  double sum_ns_ = 0.0;
+  int64_t max_ns_ = 0;
+};
+
+// Accumulates the token timestamps of the queries of a token based benchmark
+// and summarizes time to first token (TTFT), time per output token (TPOT) and
+// the inter-token latency distribution, as well as the acceptance rate of
+// speculative decoding.
+class TokenLatencyStats {
+ public:
+  // timestamps_ns[0] is when the query was issued, timestamps_ns[i] when its
+  // ith output token was produced.
+  void AddQuery(const int64_t* timestamps_ns, int count);
+  // Adds the draft tokens a query proposed and the target model accepted.
+  void AddDraftTokens(int64_t proposed, int64_t accepted);
+  void Reset();
+
+  bool Empty() const { return queries_ == 0; }
+
+  // Human-readable summary in the layout of the loadgen summary.
+  std::string Summary() const;
+
+ private:
+  uint64_t queries_ = 0;
+  uint64_t output_tokens_ = 0;
+  LatencyHistogram ttft_;
+  LatencyHistogram inter_token_;
+  // Decode time and token count after the first token, for TPOT.
+  double decode_ns_ = 0.0;
+  uint64_t decode_tokens_ = 0;
+  uint64_t draft_proposed_ = 0;
+  uint64_t draft_accepted_ = 0;
+};
+
+}  // namespace mobile
+}  // namespace mlperf
+
+#endif  // MLPERF_TOKEN_LATENCY_H_
@@ -0,0 +1,93 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "token_latency.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace mlperf {
+namespace mobile {
+namespace {
+
+using ::testing::HasSubstr;
+using ::testing::Not;
+
+TEST(LatencyHistogram, PercentilesWithinBucketWidth) {
+  LatencyHistogram histogram;
+  // 1ms to 100ms in steps of 1ms.
+  for (int i = 1; i <= 100; ++i) histogram.Add(i * 1000000LL);
+  EXPECT_EQ(histogram.Count(), 100u);
+  EXPECT_EQ(histogram.Max(), 100000000);
+  EXPECT_NEAR(histogram.Mean(), 50.5e6, 1.0);
+  EXPECT_NEAR(histogram.Percentile(0.5), 50e6, 50e6 * 0.02);
+  EXPECT_NEAR(histogram.Percentile(0.9), 90e6, 90e6 * 0.02);
+  EXPECT_NEAR(histogram.Percentile(0.99), 99e6, 99e6 * 0.02);
+  EXPECT_EQ(histogram.Percentile(1.0), 100000000);
+}
+
+TEST(LatencyHistogram, EmptyAndReset) {
+  LatencyHistogram histogram;
+  EXPECT_EQ(histogram.Percentile(0.5), 0);
+  histogram.Add(5000);
+  histogram.Reset();
+  EXPECT_EQ(histogram.Count(), 0u);
+  EXPECT_EQ(histogram.Max(), 0);
+}
+
+TEST(TokenLatencyStats, SummarizesQueries) {
+  TokenLatencyStats stats;
+  EXPECT_TRUE(stats.Empty());
+  // Issued at 0, first token after 100ms, then one token every 10ms.
+  std::vector<int64_t> timestamps = {0, 100000000, 110000000, 120000000};
+  stats.AddQuery(timestamps.data(), timestamps.size());
+  // A query without output tokens is ignored.
+  stats.AddQuery(timestamps.data(), 1);
+  EXPECT_FALSE(stats.Empty());
+
+  std::string summary = stats.Summary();
+  EXPECT_THAT(summary, HasSubstr("Queries : 1\n"));
+  EXPECT_THAT(summary, HasSubstr("Output tokens : 3\n"));
+  EXPECT_THAT(summary, HasSubstr("Mean TTFT (ms) : 100\n"));
+  EXPECT_THAT(summary, HasSubstr("Mean TPOT (ms) : 10\n"));
+}
+
+TEST(TokenLatencyStats, ReportsDraftAcceptanceRate) {
+  TokenLatencyStats stats;
+  std::vector<int64_t> timestamps = {0, 100000000, 110000000};
+  stats.AddQuery(timestamps.data(), timestamps.size());
+  EXPECT_THAT(stats.Summary(), Not(HasSubstr("Draft")));
+
+  stats.AddDraftTokens(8, 6);
+  stats.AddDraftTokens(12, 4);
+  std::string summary = stats.Summary();
+  EXPECT_THAT(summary, HasSubstr("Draft tokens proposed : 20\n"));
+  EXPECT_THAT(summary, HasSubstr("Draft tokens accepted : 10\n"));
+  EXPECT_THAT(summary, HasSubstr("Draft acceptance rate (%) : 50\n"));
+
+  stats.Reset();
+  stats.AddQuery(timestamps.data(), timestamps.size());
+  EXPECT_THAT(stats.Summary(), Not(HasSubstr("Draft")));
+}
+
+}  // namespace
+}  // namespace mobile
+}  // namespace mlperf
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
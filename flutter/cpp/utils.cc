@@ -214,6 +214,29 @@ int GetConfigValue<int>(mlperf_backend_configuration_t *configs,
   return defaultValue;
 }
 
+template <>
+float GetConfigValue<float>(mlperf_backend_configuration_t *configs,
+                            const char *key, float defaultValue) {
+  for (int i = 0; i < configs->count; ++i) {
+    if (strcmp(configs->keys[i], key) == 0) {
+      const char *valueStr = configs->values[i];
+      char *endptr = nullptr;
+      errno = 0;
+      float value = strtof(valueStr, &endptr);
+      if (errno == ERANGE) {
+        LOG(ERROR) << "Value out of range for float: " << valueStr;
+        return defaultValue;
+      }
+      if (endptr == valueStr || *endptr != '\0') {
+        LOG(ERROR) << "Invalid value for float: " << valueStr;
+        return defaultValue;
+      }
+      return value;
+    }
+  }
+  return defaultValue;
+}
+
 template <>
 std::string GetConfigValue<std::string>(mlperf_backend_configuration_t *configs,
                                         const char *key,
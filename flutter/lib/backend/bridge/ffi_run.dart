@@ -43,6 +43,8 @@ final class _RunIn extends Struct {
   external double max_duration;
   @Int32()
   external int single_stream_expected_latency_ns;
+  @Double()
+  external double server_target_qps;
   external Pointer<Utf8> output_dir;
 
   void set(RunSettings rs) {
@@ -74,6 +76,7 @@ final class _RunIn extends Struct {
     min_duration = rs.min_duration;
     max_duration = rs.max_duration;
     single_stream_expected_latency_ns = rs.single_stream_expected_latency_ns;
+    server_target_qps = rs.server_target_qps;
 
     output_dir = rs.output_dir.toNativeUtf8();
   }
@@ -23,6 +23,7 @@ class RunSettings {
   final double min_duration;
   final double max_duration;
   final int single_stream_expected_latency_ns;
+  final double server_target_qps;
   final String output_dir;
   final String benchmark_id;
 
@@ -45,6 +46,7 @@ class RunSettings {
     required this.min_duration,
     required this.max_duration,
     required this.single_stream_expected_latency_ns,
+    required this.server_target_qps,
     required this.output_dir,
     required this.benchmark_id,
   }) {
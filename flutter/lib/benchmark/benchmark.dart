@@ -113,6 +113,7 @@ class Benchmark {
       max_duration: maxDuration,
       single_stream_expected_latency_ns:
           benchmarkSettings.singleStreamExpectedLatencyNs,
+      server_target_qps: benchmarkSettings.serverTargetQps,
       output_dir: logDir,
       benchmark_id: id,
     );
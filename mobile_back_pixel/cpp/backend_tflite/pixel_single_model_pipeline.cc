@@ -132,8 +132,9 @@ mlperf_backend_ptr_t SingleModelPipeline::backend_create(
         configs->batch_size / backend_data->shards_num;
   }
 
-  backend_data->executer =
-      std::unique_ptr<Threadpool>(new Threadpool(backend_data->shards_num));
+  // The calling thread runs the first shard, so one worker less is needed.
+  backend_data->executer = std::unique_ptr<Threadpool>(
+      new Threadpool(backend_data->shards_num - 1));
 
   // Create interpreter options function.
   auto create_option = [&](TfLiteInterpreterOptions*& option_ptr) -> void {
@@ -273,28 +274,19 @@ void SingleModelPipeline::backend_delete(mlperf_backend_ptr_t backend_ptr) {
 mlperf_status_t SingleModelPipeline::backend_issue_query(
     mlperf_backend_ptr_t backend_ptr, ft_callback callback, void* context) {
   TFLiteBackendData* backend_data = (TFLiteBackendData*)backend_ptr;
-  auto task = [&backend_data](int index) -> TfLiteStatus {
-    return TfLiteInterpreterInvoke(backend_data->interpreter[index]);
-  };
-
-  std::vector<std::future<TfLiteStatus>> f;
-  f.resize(backend_data->shards_num);
-  // dispatch workers for shards
-  for (int k = 1; k < backend_data->shards_num; k++) {
-    f[k] = backend_data->executer->submit(task, k);
-  }
-  // main thread for the first shard
-  if (task(0) != kTfLiteOk) {
+  // Run all shards, the first one on the calling thread.
+  std::atomic<bool> failed{false};
+  backend_data->executer->parallel_for(
+      backend_data->shards_num, [backend_data, &failed](size_t index) {
+        if (TfLiteInterpreterInvoke(backend_data->interpreter[index]) !=
+            kTfLiteOk) {
+          failed = true;
+        }
+      });
+  if (failed) {
     printf("Failed to run the inference\n");
     return MLPERF_FAILURE;
   }
-  // sync and get result of workers
-  for (int k = 1; k < backend_data->shards_num; k++) {
-    if (f[k].get() != kTfLiteOk) {
-      printf("Failed to run the inference\n");
-      return MLPERF_FAILURE;
-    }
-  }
   return MLPERF_SUCCESS;
 }
 
@@ -417,6 +409,13 @@ void SingleModelPipeline::backend_convert_outputs(
     mlperf_backend_ptr_t backend_ptr, int bytes, int width, int height,
     uint8_t* data) {}
 
+mlperf_status_t SingleModelPipeline::backend_bind_input(
+    mlperf_backend_ptr_t backend_ptr, int32_t batch_index, int32_t i,
+    void* data) {
+  // Inputs are always copied in backend_set_input.
+  return MLPERF_FAILURE;
+}
+
 void* SingleModelPipeline::backend_get_buffer(size_t n) {
   return ::operator new(n);
 }
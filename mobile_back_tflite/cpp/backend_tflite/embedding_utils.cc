@@ -36,11 +36,13 @@ bool TsEmbeddingParser::parse_pickle(const std::string& filename) {
   return true;
 }
 
-std::vector<float> TsEmbeddingParser::get_timestep_embedding(
+static const std::vector<float> kNoEmbedding;
+
+const std::vector<float>& TsEmbeddingParser::get_timestep_embedding(
     int32_t steps, int32_t step_index) const {
   auto emb_it = embeddings_.find(steps);
   if (emb_it == embeddings_.end() || step_index >= emb_it->second.size()) {
-    return {};
+    return kNoEmbedding;
   }
   return emb_it->second[step_index];
 }
@@ -58,9 +60,9 @@ bool EmbeddingManager::load_timestep_embeddings(const std::string& filename) {
   return ts_parser_->parse_pickle(filename);
 }
 
-std::vector<float> EmbeddingManager::get_timestep_embedding(
+const std::vector<float>& EmbeddingManager::get_timestep_embedding(
     int32_t timestep, int num_steps) const {
-  if (!ts_parser_) return {};
+  if (!ts_parser_) return kNoEmbedding;
   return ts_parser_->get_timestep_embedding(num_steps, timestep);
 }
 
@@ -0,0 +1,72 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "kv_cache_utils.h"
+
+namespace {
+
+const TfLiteAffineQuantization* GetAffineQuantization(
+    const TfLiteTensor* tensor) {
+  if (tensor->quantization.type != kTfLiteAffineQuantization) return nullptr;
+  return static_cast<const TfLiteAffineQuantization*>(
+      tensor->quantization.params);
+}
+
+}  // namespace
+
+bool ParseKVCacheType(const std::string& name, KVCacheType* type) {
+  if (name == "float32") {
+    *type = KVCacheType::kFloat32;
+  } else if (name == "float16") {
+    *type = KVCacheType::kFloat16;
+  } else if (name == "int8") {
+    *type = KVCacheType::kInt8;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+const char* KVCacheTypeName(KVCacheType type) {
+  switch (type) {
+    case KVCacheType::kFloat32:
+      return "float32";
+    case KVCacheType::kFloat16:
+      return "float16";
+    case KVCacheType::kInt8:
+      return "int8";
+  }
+  return "unknown";
+}
+
+bool IsValidKVCacheTensor(const TfLiteTensor* tensor, KVCacheType type) {
+  if (tensor == nullptr || tensor->dims == nullptr ||
+      tensor->dims->size != 4 || tensor->dims->data[0] < 1) {
+    return false;
+  }
+  switch (type) {
+    case KVCacheType::kFloat32:
+      return tensor->type == kTfLiteFloat32;
+    case KVCacheType::kFloat16:
+      return tensor->type == kTfLiteFloat16;
+    case KVCacheType::kInt8: {
+      const TfLiteAffineQuantization* params = GetAffineQuantization(tensor);
+      return tensor->type == kTfLiteInt8 && params != nullptr &&
+             params->quantized_dimension == 2 && params->scale != nullptr &&
+             params->scale->size == tensor->dims->data[2];
+    }
+  }
+  return false;
+}
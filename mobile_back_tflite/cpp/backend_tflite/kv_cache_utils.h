@@ -0,0 +1,41 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TFLITE_KV_CACHE_UTILS_H_
+#define TFLITE_KV_CACHE_UTILS_H_
+
+#include <cstdint>
+#include <string>
+
+#include "tensorflow/lite/c/common.h"
+
+// Element type of the KV cache tensors, selected with the kv_cache_type
+// custom setting. The model must be exported with KV cache inputs of the
+// same type.
+enum class KVCacheType { kFloat32, kFloat16, kInt8 };
+
+// Parses "float32", "float16" or "int8". Returns false for other values.
+bool ParseKVCacheType(const std::string &name, KVCacheType *type);
+
+const char *KVCacheTypeName(KVCacheType type);
+
+// Checks that a KV cache tensor of shape [Batch, kv_cache_max,
+// num_query_groups, head_dim] stores `type`. Any batch size is accepted, each
+// batch row being the KV cache slot of one sequence. int8 tensors need
+// per-head affine quantization, i.e. one scale per query group along
+// dimension 2, shared by all slots.
+bool IsValidKVCacheTensor(const TfLiteTensor *tensor, KVCacheType type);
+
+#endif  // TFLITE_KV_CACHE_UTILS_H_
@@ -0,0 +1,314 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "kv_cache_utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+constexpr int kKVCacheMax = 16;
+constexpr int kNumHeads = 2;
+constexpr int kHeadDim = 4;
+
+size_t TypeSize(TfLiteType type) {
+  switch (type) {
+    case kTfLiteFloat32:
+      return sizeof(float);
+    case kTfLiteFloat16:
+      return sizeof(uint16_t);
+    default:
+      return sizeof(int8_t);
+  }
+}
+
+float HalfToFloat(uint16_t half) {
+  uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+  uint32_t exponent = (half >> 10) & 0x1fu;
+  uint32_t mantissa = half & 0x3ffu;
+  uint32_t bits;
+  if (exponent == 0) {
+    // Zero or subnormal.
+    float value = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -value : value;
+  } else if (exponent == 0x1f) {
+    bits = sign | 0x7f800000u | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+uint16_t FloatToHalf(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000u;
+  uint32_t abs = bits & 0x7fffffffu;
+  if (abs > 0x7f800000u) return sign | 0x7e00u;  // NaN
+  // 65520 and above round to infinity.
+  if (abs >= 0x477ff000u) return sign | 0x7c00u;
+  if (abs < 0x38800000u) {
+    // Below the smallest normal half, in units of 2^-24.
+    float magnitude;
+    std::memcpy(&magnitude, &abs, sizeof(magnitude));
+    float units = std::nearbyint(magnitude * 16777216.0f);
+    return sign | static_cast<uint16_t>(units);
+  }
+  // Rebias the exponent and round the mantissa to nearest even.
+  abs += 0xc8000fffu + ((abs >> 13) & 1u);
+  return sign | static_cast<uint16_t>(abs >> 13);
+}
+
+const TfLiteAffineQuantization* GetAffineQuantization(
+    const TfLiteTensor* tensor) {
+  if (tensor->quantization.type != kTfLiteAffineQuantization) return nullptr;
+  return static_cast<const TfLiteAffineQuantization*>(
+      tensor->quantization.params);
+}
+
+int ZeroPoint(const TfLiteAffineQuantization* params, int head) {
+  if (params->zero_point == nullptr || params->zero_point->size == 0) return 0;
+  return params->zero_point->size == 1 ? params->zero_point->data[0]
+                                       : params->zero_point->data[head];
+}
+
+// CPU reference of the dequantize-on-read done by the SDPA op for float16 and
+// int8 KV caches, on tensors accepted by IsValidKVCacheTensor. Writes the
+// num_query_groups * head_dim values stored at `position` of `tensor` to
+// `out`, reading the elements from `data`.
+void DequantizeKVCacheRow(const TfLiteTensor* tensor, const void* data,
+                          int position, float* out) {
+  const int num_heads = tensor->dims->data[2];
+  const int head_dim = tensor->dims->data[3];
+  const size_t offset = static_cast<size_t>(position) * num_heads * head_dim;
+  switch (tensor->type) {
+    case kTfLiteFloat32: {
+      const float* row = static_cast<const float*>(data) + offset;
+      std::copy(row, row + num_heads * head_dim, out);
+      break;
+    }
+    case kTfLiteFloat16: {
+      const uint16_t* row = static_cast<const uint16_t*>(data) + offset;
+      for (int i = 0; i < num_heads * head_dim; ++i) {
+        out[i] = HalfToFloat(row[i]);
+      }
+      break;
+    }
+    case kTfLiteInt8: {
+      const TfLiteAffineQuantization* params = GetAffineQuantization(tensor);
+      const int8_t* row = static_cast<const int8_t*>(data) + offset;
+      for (int h = 0; h < num_heads; ++h) {
+        const float scale = params->scale->data[h];
+        const int zero_point = ZeroPoint(params, h);
+        for (int d = 0; d < head_dim; ++d) {
+          int i = h * head_dim + d;
+          out[i] = scale * static_cast<float>(row[i] - zero_point);
+        }
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+// Inverse of DequantizeKVCacheRow, rounding to the nearest representable
+// value and saturating int8 values.
+void QuantizeKVCacheRow(const TfLiteTensor* tensor, const float* in,
+                        int position, void* data) {
+  const int num_heads = tensor->dims->data[2];
+  const int head_dim = tensor->dims->data[3];
+  const size_t offset = static_cast<size_t>(position) * num_heads * head_dim;
+  switch (tensor->type) {
+    case kTfLiteFloat32: {
+      std::copy(in, in + num_heads * head_dim,
+                static_cast<float*>(data) + offset);
+      break;
+    }
+    case kTfLiteFloat16: {
+      uint16_t* row = static_cast<uint16_t*>(data) + offset;
+      for (int i = 0; i < num_heads * head_dim; ++i) {
+        row[i] = FloatToHalf(in[i]);
+      }
+      break;
+    }
+    case kTfLiteInt8: {
+      const TfLiteAffineQuantization* params = GetAffineQuantization(tensor);
+      int8_t* row = static_cast<int8_t*>(data) + offset;
+      for (int h = 0; h < num_heads; ++h) {
+        const float scale = params->scale->data[h];
+        const int zero_point = ZeroPoint(params, h);
+        for (int d = 0; d < head_dim; ++d) {
+          int i = h * head_dim + d;
+          int value = static_cast<int>(std::lround(in[i] / scale));
+          value += zero_point;
+          row[i] = static_cast<int8_t>(std::clamp(value, -128, 127));
+        }
+      }
+      break;
+    }
+    default:
+      break;
+  }
+}
+
+// A KV cache input tensor of shape [batch, kKVCacheMax, kNumHeads, kHeadDim]
+// without data, as the decode signature reports it.
+class KVCacheTensor {
+ public:
+  KVCacheTensor(int batch, TfLiteType type) {
+    tensor_.type = type;
+    tensor_.dims = TfLiteIntArrayCreate(4);
+    tensor_.dims->data[0] = batch;
+    tensor_.dims->data[1] = kKVCacheMax;
+    tensor_.dims->data[2] = kNumHeads;
+    tensor_.dims->data[3] = kHeadDim;
+    tensor_.bytes = TypeSize(type) * batch * kKVCacheMax * kNumHeads * kHeadDim;
+    if (type == kTfLiteInt8) {
+      quantization_.scale = TfLiteFloatArrayCreate(kNumHeads);
+      quantization_.zero_point = TfLiteIntArrayCreate(kNumHeads);
+      for (int h = 0; h < kNumHeads; ++h) {
+        quantization_.scale->data[h] = 0.5f / (h + 1);
+        quantization_.zero_point->data[h] = h;
+      }
+      quantization_.quantized_dimension = 2;
+      tensor_.quantization.type = kTfLiteAffineQuantization;
+      tensor_.quantization.params = &quantization_;
+    }
+  }
+
+  ~KVCacheTensor() {
+    TfLiteIntArrayFree(tensor_.dims);
+    if (quantization_.scale) TfLiteFloatArrayFree(quantization_.scale);
+    if (quantization_.zero_point) TfLiteIntArrayFree(quantization_.zero_point);
+  }
+
+  TfLiteTensor* get() { return &tensor_; }
+
+ private:
+  TfLiteTensor tensor_ = {};
+  TfLiteAffineQuantization quantization_ = {};
+};
+
+TEST(KVCacheUtils, AcceptsBatchedKVCache) {
+  for (KVCacheType type :
+       {KVCacheType::kFloat32, KVCacheType::kFloat16, KVCacheType::kInt8}) {
+    TfLiteType tensor_type = type == KVCacheType::kFloat32   ? kTfLiteFloat32
+                             : type == KVCacheType::kFloat16 ? kTfLiteFloat16
+                                                             : kTfLiteInt8;
+    KVCacheTensor single(1, tensor_type);
+    KVCacheTensor batched(2, tensor_type);
+    EXPECT_TRUE(IsValidKVCacheTensor(single.get(), type))
+        << KVCacheTypeName(type);
+    EXPECT_TRUE(IsValidKVCacheTensor(batched.get(), type))
+        << KVCacheTypeName(type);
+  }
+}
+
+TEST(KVCacheUtils, BuildsBatchedKVCacheSlots) {
+  // The cache is allocated like LLMPipeline::BuildKVCache does, and each
+  // sequence owns a contiguous slot of kv_cache_max rows.
+  KVCacheTensor tensor(2, kTfLiteFloat32);
+  ASSERT_TRUE(IsValidKVCacheTensor(tensor.get(), KVCacheType::kFloat32));
+  std::vector<uint8_t> cache(tensor.get()->bytes, 0);
+  size_t slot_size = cache.size() / tensor.get()->dims->data[0];
+  size_t row_size = slot_size / kKVCacheMax;
+  EXPECT_EQ(slot_size, sizeof(float) * kKVCacheMax * kNumHeads * kHeadDim);
+  EXPECT_EQ(row_size, sizeof(float) * kNumHeads * kHeadDim);
+}
+
+TEST(KVCacheUtils, RejectsInvalidKVCache) {
+  KVCacheTensor empty_batch(0, kTfLiteFloat32);
+  EXPECT_FALSE(IsValidKVCacheTensor(empty_batch.get(), KVCacheType::kFloat32));
+  KVCacheTensor float16(2, kTfLiteFloat16);
+  EXPECT_FALSE(IsValidKVCacheTensor(float16.get(), KVCacheType::kFloat32));
+  // int8 needs the per-head scales.
+  KVCacheTensor float32(2, kTfLiteFloat32);
+  float32.get()->type = kTfLiteInt8;
+  EXPECT_FALSE(IsValidKVCacheTensor(float32.get(), KVCacheType::kInt8));
+  EXPECT_FALSE(IsValidKVCacheTensor(nullptr, KVCacheType::kFloat32));
+}
+
+TEST(KVCacheUtils, RoundTripsInt8RowWithPerHeadScales) {
+  KVCacheTensor tensor(2, kTfLiteInt8);
+  ASSERT_TRUE(IsValidKVCacheTensor(tensor.get(), KVCacheType::kInt8));
+  std::vector<int8_t> cache(tensor.get()->bytes, 0);
+  // Head h has the scale 0.5 / (h + 1) and the zero point h.
+  std::vector<float> row(kNumHeads * kHeadDim);
+  for (int h = 0; h < kNumHeads; ++h) {
+    for (int d = 0; d < kHeadDim; ++d) {
+      row[h * kHeadDim + d] = (d - 1.6f) * (h + 1);
+    }
+  }
+  // The first row of the second slot.
+  int position = kKVCacheMax;
+  QuantizeKVCacheRow(tensor.get(), row.data(), position, cache.data());
+  std::vector<float> restored(row.size());
+  DequantizeKVCacheRow(tensor.get(), cache.data(), position, restored.data());
+  for (int h = 0; h < kNumHeads; ++h) {
+    float scale = 0.5f / (h + 1);
+    for (int d = 0; d < kHeadDim; ++d) {
+      int i = h * kHeadDim + d;
+      EXPECT_NEAR(restored[i], row[i], scale / 2) << "head " << h;
+      int8_t stored = cache[position * kNumHeads * kHeadDim + i];
+      EXPECT_EQ(stored, static_cast<int>(std::lround(row[i] / scale)) + h);
+    }
+  }
+  // Other rows stay untouched.
+  for (int i = 0; i < position * kNumHeads * kHeadDim; ++i) {
+    ASSERT_EQ(cache[i], 0);
+  }
+}
+
+TEST(KVCacheUtils, SaturatesInt8Row) {
+  KVCacheTensor tensor(1, kTfLiteInt8);
+  std::vector<int8_t> cache(tensor.get()->bytes, 0);
+  std::vector<float> row(kNumHeads * kHeadDim, 1000.0f);
+  row[0] = -1000.0f;
+  QuantizeKVCacheRow(tensor.get(), row.data(), 0, cache.data());
+  EXPECT_EQ(cache[0], -128);
+  EXPECT_EQ(cache[1], 127);
+  EXPECT_EQ(cache[kHeadDim], 127);
+}
+
+TEST(KVCacheUtils, RoundTripsFloat16Row) {
+  KVCacheTensor tensor(1, kTfLiteFloat16);
+  std::vector<uint16_t> cache(tensor.get()->bytes / sizeof(uint16_t), 0);
+  std::vector<float> row = {0.0f, -0.0f, 1.0f, -2.5f, 0.333f, 65504.0f,
+                            1e-7f, 1e6f};
+  QuantizeKVCacheRow(tensor.get(), row.data(), 3, cache.data());
+  std::vector<float> restored(row.size());
+  DequantizeKVCacheRow(tensor.get(), cache.data(), 3, restored.data());
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_NEAR(restored[i], row[i], std::abs(row[i]) / 1024) << i;
+  }
+  EXPECT_EQ(restored[5], 65504.0f);
+  EXPECT_NEAR(restored[6], 1e-7f, 3e-8f);
+  EXPECT_TRUE(std::isinf(restored[7]));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
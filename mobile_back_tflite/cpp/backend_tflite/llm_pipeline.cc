@@ -15,9 +15,12 @@ limitations under the License.
 
 #include "llm_pipeline.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <functional>
+#include <string_view>
 
 #if defined(MTK_TFLITE_NEURON_BACKEND) && defined(__ANDROID__)
 #include <dlfcn.h>
@@ -36,9 +39,17 @@ extern "C" {
 
 static bool backendExists = false;
 
+// Shorter shared prefixes are cheaper to prefill than to keep a copy of.
+static constexpr size_t kMinSnapshotTokens = 32;
+
 // Destroy the backend pointer and its data.
 void LLMPipeline::backend_delete(mlperf_backend_ptr_t backend_ptr) {
   LLMBackendData* backend_data = (LLMBackendData*)backend_ptr;
+  if (backend_data && backend_data->proposed_tokens > 0) {
+    LOG(INFO) << "Speculative decoding accepted "
+              << backend_data->accepted_tokens << " of "
+              << backend_data->proposed_tokens << " draft tokens";
+  }
   if (backend_data) delete backend_data;
   backendExists = false;
 }
@@ -91,11 +102,131 @@ mlperf_backend_ptr_t LLMPipeline::backend_create(
     return nullptr;
   }
 
-  backend_data->kv_cache = BuildKVCache(backend_data->interpreter);
-  // TODO kv_cache check
+  std::string kv_cache_type = mlperf::mobile::GetConfigValue(
+      configs, "kv_cache_type", std::string("float32"));
+  if (!ParseKVCacheType(kv_cache_type, &backend_data->kv_cache_type)) {
+    LOG(ERROR) << "Unsupported kv_cache_type: " << kv_cache_type;
+    backend_delete(backend_data);
+    return nullptr;
+  }
+
+  backend_data->kv_cache =
+      BuildKVCache(backend_data->interpreter, backend_data->kv_cache_type);
+  if (backend_data->kv_cache.empty()) {
+    LOG(ERROR) << "Failed to build a " << kv_cache_type << " KV cache";
+    backend_delete(backend_data);
+    return nullptr;
+  }
 
   backend_data->decode_runner =
       GetDecodeRunner(backend_data->interpreter, backend_data->kv_cache);
+  if (!backend_data->decode_runner) {
+    LOG(ERROR) << "Failed to prepare the decode runner";
+    backend_delete(backend_data);
+    return nullptr;
+  }
+
+  // kv_cache_k_0 has the shape [Batch, kv_cache_max, num_query_groups,
+  // head_dim], so a position is a contiguous row.
+  backend_data->kv_cache_max =
+      backend_data->decode_runner->input_tensor("kv_cache_k_0")->dims->data[1];
+  // The query start and at most one timestamp per KV cache position.
+  backend_data->token_timestamps.Allocate(backend_data->kv_cache_max + 1);
+  // The tokens input has the shape [Batch, Seq]. Each batch row owns a
+  // contiguous slot of every KV cache buffer.
+  backend_data->decode_batch =
+      backend_data->decode_runner->input_tensor("tokens")->dims->data[0];
+  backend_data->kv_cache_slot_size =
+      backend_data->kv_cache.at("kv_cache_k_0").size() /
+      backend_data->decode_batch;
+  backend_data->kv_cache_row_size =
+      backend_data->kv_cache_slot_size / backend_data->kv_cache_max;
+  backend_data->prefill_runners =
+      GetPrefillRunners(backend_data->interpreter, backend_data->kv_cache);
+  if (backend_data->prefill_runners.empty()) {
+    LOG(ERROR) << "No prefill signature found in the model";
+    backend_delete(backend_data);
+    return nullptr;
+  }
+  backend_data->max_prefix_snapshots =
+      mlperf::mobile::GetConfigValue(configs, "prefix_cache_size", 1);
+
+  // Greedy decoding unless a sampler temperature is set.
+  SamplerParams sampler_params;
+  sampler_params.temperature =
+      mlperf::mobile::GetConfigValue(configs, "sampler_temperature", 0.0f);
+  sampler_params.top_p =
+      mlperf::mobile::GetConfigValue(configs, "sampler_top_p", 1.0f);
+  sampler_params.top_k =
+      mlperf::mobile::GetConfigValue(configs, "sampler_top_k", 0);
+  sampler_params.seed = static_cast<uint64_t>(
+      mlperf::mobile::GetConfigValue(configs, "sampler_seed", 0));
+  backend_data->sampler = Sampler(sampler_params);
+
+  std::string draft_model_filename = mlperf::mobile::GetConfigValue(
+      configs, "draft_model_filename", std::string(""));
+  if (!draft_model_filename.empty()) {
+    // Draft proposals are checked against the target argmax, so speculative
+    // decoding is only exact for greedy decoding.
+    if (!backend_data->sampler.IsGreedy()) {
+      LOG(ERROR) << "Speculative decoding requires greedy sampling";
+      backend_delete(backend_data);
+      return nullptr;
+    }
+    backend_data->verify_runner =
+        backend_data->interpreter->GetSignatureRunner("verify");
+    if (!backend_data->verify_runner) {
+      LOG(ERROR) << "Speculative decoding requires a verify signature";
+      backend_delete(backend_data);
+      return nullptr;
+    }
+    PrepareRunner(backend_data->verify_runner, backend_data->kv_cache);
+    int max_draft_tokens =
+        backend_data->verify_runner->input_tensor("input_pos")->dims->data[0] -
+        1;
+    backend_data->draft_tokens = std::min(
+        mlperf::mobile::GetConfigValue(configs, "draft_tokens",
+                                       max_draft_tokens),
+        max_draft_tokens);
+
+    std::string draft_model_path =
+        llm_model_path.substr(0, llm_model_path.rfind('/') + 1) +
+        draft_model_filename;
+    backend_data->draft =
+        LoadDraftModel(draft_model_path, backend_data->num_threads,
+                       backend_data->kv_cache_type);
+    if (!backend_data->draft || backend_data->draft_tokens <= 0) {
+      LOG(ERROR) << "Failed to prepare the draft model: " << draft_model_path;
+      backend_delete(backend_data);
+      return nullptr;
+    }
+  }
+
+  if (backend_data->decode_batch > 1) {
+    // Every sequence decodes at its own position, and prompts are prefilled
+    // one at a time into the KV cache slot of their sequence.
+    TfLiteTensor* input_pos =
+        backend_data->decode_runner->input_tensor("input_pos");
+    bool valid =
+        input_pos->dims->data[0] == backend_data->decode_batch &&
+        backend_data->kv_cache_slot_size % tflite::kDefaultTensorAlignment ==
+            0 &&
+        !backend_data->draft;
+    for (const auto& [size, runner] : backend_data->prefill_runners) {
+      valid = valid && runner->input_tensor("kv_cache_k_0")->bytes ==
+                           backend_data->kv_cache_slot_size;
+      backend_data->prefill_slots[runner] = 0;
+    }
+    if (!valid) {
+      LOG(ERROR) << "Batched decoding requires one input position per "
+                 << "sequence, batch size 1 prefill signatures and no "
+                 << "draft model";
+      backend_delete(backend_data);
+      return nullptr;
+    }
+    LOG(INFO) << "Decoding up to " << backend_data->decode_batch
+              << " sequences at a time";
+  }
 
   return backend_data;
 }
@@ -123,50 +254,28 @@ const char* LLMPipeline::backend_name(mlperf_backend_ptr_t backend_ptr) {
 mlperf_status_t LLMPipeline::backend_issue_first_token_query(
     mlperf_backend_ptr_t backend_ptr) {
   LLMBackendData* backend_data = (LLMBackendData*)backend_ptr;
-
-  int max_seq_size = backend_data->tensors.prefill_input()->dims->data[1];
-  int kv_cache_max_size = backend_data->tensors.kv_cache_k_0()->dims->data[1];
-  int prefill_seq_size = std::min(
-      static_cast<int>(backend_data->prompt_tokens.size()), max_seq_size);
-  bool prefill_overflow =
-      static_cast<int>(backend_data->prompt_tokens.size()) > max_seq_size;
-  int overflow_size =
-      prefill_overflow
-          ? static_cast<int>(backend_data->prompt_tokens.size()) - max_seq_size
-          : 0;
-  int prefill_amount =
-      prefill_overflow ? prefill_seq_size : (prefill_seq_size - 1);
-  int decode_tokens = prefill_overflow ? overflow_size - 1 : 1;
-
-  std::memset(backend_data->tensors.prefill_input()->data.i32, 0,
-              backend_data->tensors.prefill_input()->bytes);
-  std::memset(backend_data->tensors.prefill_input_pos()->data.i32, 0,
-              backend_data->tensors.prefill_input_pos()->bytes);
-  // If the prefill can fit the entire input, leave one token for decode,
-  // otherwise prefill as much of the input as possible.
-  int i = 0;
-  for (; i < prefill_amount; ++i) {
-    backend_data->tensors.prefill_input()->data.i32[i] =
-        backend_data->prompt_tokens[i];
-    backend_data->tensors.prefill_input_pos()->data.i32[i] = i;
-  }
-  for (; i < max_seq_size; ++i) {
-    backend_data->tensors.prefill_input()->data.i32[i] = 128009;
-    backend_data->tensors.prefill_input_pos()->data.i32[i] = i;
-  }
-
-  MINIMAL_CHECK(backend_data->prefill_runner->Invoke() == kTfLiteOk);
-
-  // Run decode once if input fits inside prefill, otherwise decode the rest of
-  // the input one by one
-  int next_token = backend_data->prompt_tokens[prefill_amount];
-  int next_position = prefill_amount;
-  for (int i = 0; i < decode_tokens; ++i) {
-    backend_data->tensors.decode_input()->data.i32[0] = next_token;
-    backend_data->tensors.decode_input_pos()->data.i32[0] = next_position;
-    MINIMAL_CHECK(backend_data->decode_runner->Invoke() == kTfLiteOk);
-    next_token = backend_data->prompt_tokens[++next_position];
+  const std::vector<int>& prompt = backend_data->prompt_tokens;
+  int input_size = static_cast<int>(prompt.size());
+
+  // Positions before reused_prefix already hold the KV cache rows of the
+  // prompt. The last prompt token is left to decode so that it produces the
+  // logits of the first output token.
+  int position = backend_data->reused_prefix;
+  for (const PrefillChunk& chunk : backend_data->prefill_chunks) {
+    MINIMAL_CHECK(InvokeMultiToken(chunk.runner, &prompt[position], chunk.size,
+                                   position, backend_data->kv_cache_max) ==
+                  MLPERF_SUCCESS);
+    auto prefilled = prompt.begin() + position;
+    backend_data->cached_tokens.insert(backend_data->cached_tokens.end(),
+                                       prefilled, prefilled + chunk.size);
+    position += chunk.size;
   }
+  MINIMAL_CHECK(position == input_size - 1);
+
+  backend_data->tensors.decode_input()->data.i32[0] = prompt[position];
+  backend_data->tensors.decode_input_pos()->data.i32[0] = position;
+  MINIMAL_CHECK(backend_data->decode_runner->Invoke() == kTfLiteOk);
+  backend_data->cached_tokens.push_back(prompt[position]);
 
   return MLPERF_SUCCESS;
 }
@@ -184,7 +293,18 @@ mlperf_status_t LLMPipeline::backend_issue_query(
     return false;
   };
 
-  backend_issue_first_token_query(backend_ptr);
+  backend_data->token_timestamps.Clear();
+  backend_data->query_proposed_tokens = 0;
+  backend_data->query_accepted_tokens = 0;
+  if (backend_data->decode_batch > 1) {
+    // Batched sequences share every decode invocation, so there are no
+    // per-query token timestamps.
+    return IssueBatchedQuery(backend_data, callback, context);
+  }
+  backend_data->token_timestamps.Record();
+  MINIMAL_CHECK(backend_issue_first_token_query(backend_ptr) ==
+                MLPERF_SUCCESS);
+  backend_data->token_timestamps.Record();
   callback(context);
 
   int kv_cache_max_size = backend_data->tensors.kv_cache_k_0()->dims->data[1];
@@ -199,18 +319,49 @@ mlperf_status_t LLMPipeline::backend_issue_query(
   MINIMAL_CHECK(decode_steps > 0);
 
   backend_data->output_tokens.reserve(decode_steps);
-  int next_token = GreedySampler(backend_data->tensors.logits_output());
+  int next_token = SampleNextToken(backend_data);
   if (check_stop_id(next_token)) return MLPERF_SUCCESS;
   backend_data->output_tokens.push_back(next_token);
+  if (!StreamToken(backend_data, 0, next_token)) return MLPERF_SUCCESS;
   int next_position = input_size;
-  for (int i = 0; i < decode_steps; ++i) {
+  std::vector<int> speculated;
+  for (int i = 0; i < decode_steps;) {
+    int num_proposals = 0;
+    if (backend_data->draft) {
+      // Leave room for the target's own token, within the output limit and
+      // the draft KV cache.
+      num_proposals = std::min({backend_data->draft_tokens,
+                                decode_steps - i - 1,
+                                backend_data->draft->kv_cache_max -
+                                    next_position - 1});
+    }
+    if (num_proposals > 0) {
+      MINIMAL_CHECK(SpeculateTokens(backend_data, next_token, next_position,
+                                    num_proposals,
+                                    &speculated) == MLPERF_SUCCESS);
+      for (int token : speculated) {
+        backend_data->output_tokens.push_back(token);
+        backend_data->token_timestamps.Record();
+        if (check_stop_id(token)) return MLPERF_SUCCESS;
+        if (!StreamToken(backend_data, 0, token)) return MLPERF_SUCCESS;
+      }
+      next_token = speculated.back();
+      next_position += speculated.size();
+      i += speculated.size();
+      continue;
+    }
+
     backend_data->tensors.decode_input()->data.i32[0] = next_token;
     backend_data->tensors.decode_input_pos()->data.i32[0] = next_position;
     MINIMAL_CHECK(backend_data->decode_runner->Invoke() == kTfLiteOk);
-    next_token = GreedySampler(backend_data->tensors.logits_output());
+    backend_data->cached_tokens.push_back(next_token);
+    next_token = SampleNextToken(backend_data);
     backend_data->output_tokens.push_back(next_token);
+    backend_data->token_timestamps.Record();
     next_position += 1;
+    i += 1;
     if (check_stop_id(next_token)) break;
+    if (!StreamToken(backend_data, 0, next_token)) break;
   }
 
   return MLPERF_SUCCESS;
@@ -251,33 +402,54 @@ mlperf_status_t LLMPipeline::backend_set_input(mlperf_backend_ptr_t backend_ptr,
     return MLPERF_SUCCESS;
   }
 
-  for (auto& [_, vec] : backend_data->kv_cache) {
-    std::fill(vec.begin(), vec.end(), 0.0f);
+  const std::vector<int>& tokens = *(reinterpret_cast<std::vector<int>*>(data));
+  MINIMAL_CHECK(!tokens.empty());
+  if (static_cast<int>(tokens.size()) > backend_data->kv_cache_max) {
+    LOG(ERROR) << "Input size (" << std::to_string(tokens.size())
+               << ") exceeds KV cache limit ("
+               << std::to_string(backend_data->kv_cache_max) << ")."
+               << std::endl;
+    return MLPERF_FAILURE;
   }
 
-  backend_data->prompt_tokens = *(reinterpret_cast<std::vector<int>*>(data));
-
-  uint16_t effective_prefill_token_size =
-      backend_data->prompt_tokens.size() - 1;  // assuming max tokens is <16k
+  if (backend_data->decode_batch > 1) {
+    // The prompt waits in the queue until backend_issue_query.
+    auto& prompts = backend_data->batch_prompts;
+    if (prompts.size() <= static_cast<size_t>(batch_index)) {
+      prompts.resize(batch_index + 1);
+    }
+    prompts[batch_index] = tokens;
+    MINIMAL_CHECK(
+        backend_data->tensors.get_tensors(backend_data->decode_runner));
+    return MLPERF_SUCCESS;
+  }
 
-  backend_data->prefill_runner =
-      GetPrefillRunner(backend_data->interpreter, effective_prefill_token_size,
-                       backend_data->kv_cache);
+  backend_data->prompt_tokens = tokens;
+  backend_data->query_counter++;
+  backend_data->sampler.Reset();
+
+  // KV cache rows after the reused prefix are not reset. Attention is masked
+  // by input_pos, so stale rows past the current position are never read,
+  // and every row before it is written by this query.
+  ReusePromptPrefix(backend_data);
+
+  // Split the prompt tokens to prefill into chunks, using the largest prefill
+  // signature until the rest fits in a single one.
+  backend_data->prefill_chunks.clear();
+  size_t remaining = backend_data->prompt_tokens.size() - 1 -
+                     static_cast<size_t>(backend_data->reused_prefix);
+  while (remaining > 0) {
+    tflite::SignatureRunner* runner =
+        GetPrefillRunner(backend_data->prefill_runners, remaining);
+    // The expected shape for input position is [Seq].
+    size_t seq_size = runner->input_tensor("input_pos")->dims->data[0];
+    size_t size = std::min(remaining, seq_size);
+    backend_data->prefill_chunks.push_back({runner, static_cast<int>(size)});
+    remaining -= size;
+  }
 
   // Get the necessary tensor pointers for inference.
-  backend_data->tensors.get_tensors(backend_data->prefill_runner,
-                                    backend_data->decode_runner);
-
-  if (effective_prefill_token_size + 1 >
-      backend_data->tensors.kv_cache_k_0()->dims->data[1]) {
-    LOG(ERROR) << "Input size ("
-               << std::to_string(effective_prefill_token_size + 1)
-               << ") exceeds KV cache limit ("
-               << std::to_string(
-                      backend_data->tensors.kv_cache_k_0()->dims->data[1])
-               << ")." << std::endl;
-    return MLPERF_FAILURE;
-  }
+  MINIMAL_CHECK(backend_data->tensors.get_tensors(backend_data->decode_runner));
 
   return MLPERF_SUCCESS;
 }
@@ -302,6 +474,12 @@ mlperf_status_t LLMPipeline::backend_get_output(
 
   if (i != 0) return MLPERF_FAILURE;
 
+  if (backend_data->decode_batch > 1) {
+    MINIMAL_CHECK(batch_index < backend_data->batch_outputs.size());
+    *data = reinterpret_cast<void*>(&backend_data->batch_outputs[batch_index]);
+    return MLPERF_SUCCESS;
+  }
+
   *data = reinterpret_cast<void*>(&backend_data->output_tokens);
   return MLPERF_SUCCESS;
 }
@@ -314,6 +492,30 @@ void LLMPipeline::backend_convert_outputs(mlperf_backend_ptr_t backend_ptr,
                                           int bytes, int width, int height,
                                           uint8_t* data) {}
 
+int32_t LLMPipeline::backend_get_token_timestamps(
+    mlperf_backend_ptr_t backend_ptr, int64_t* timestamps_ns,
+    int32_t capacity) {
+  LLMBackendData* backend_data = (LLMBackendData*)backend_ptr;
+  return backend_data->token_timestamps.CopyTo(timestamps_ns, capacity);
+}
+
+mlperf_status_t LLMPipeline::backend_get_draft_token_counts(
+    mlperf_backend_ptr_t backend_ptr, int64_t* proposed, int64_t* accepted) {
+  LLMBackendData* backend_data = (LLMBackendData*)backend_ptr;
+  if (!backend_data->draft) return MLPERF_FAILURE;
+  *proposed = static_cast<int64_t>(backend_data->query_proposed_tokens);
+  *accepted = static_cast<int64_t>(backend_data->query_accepted_tokens);
+  return MLPERF_SUCCESS;
+}
+
+mlperf_status_t LLMPipeline::backend_set_token_callback(
+    mlperf_backend_ptr_t backend_ptr, token_callback callback, void* context) {
+  LLMBackendData* backend_data = (LLMBackendData*)backend_ptr;
+  backend_data->on_token = callback;
+  backend_data->on_token_context = context;
+  return MLPERF_SUCCESS;
+}
+
 void* LLMPipeline::backend_get_buffer(size_t n) { return ::operator new(n); }
 
 void LLMPipeline::backend_release_buffer(void* p) { ::operator delete(p); }
@@ -334,7 +536,8 @@ tflite::Interpreter* LLMPipeline::BuildInterpreter(
   return interpreter.release();
 }
 
-kv_cache_t LLMPipeline::BuildKVCache(tflite::Interpreter* interpreter) {
+kv_cache_t LLMPipeline::BuildKVCache(tflite::Interpreter* interpreter,
+                                     KVCacheType type) {
   tflite::SignatureRunner* runner = interpreter->GetSignatureRunner("decode");
   if (runner == nullptr) {
     return {};
@@ -350,13 +553,16 @@ kv_cache_t LLMPipeline::BuildKVCache(tflite::Interpreter* interpreter) {
   for (int i = 0; i < num_layers; ++i) {
     std::string k_cache_name = "kv_cache_k_" + std::to_string(i);
     std::string v_cache_name = "kv_cache_v_" + std::to_string(i);
-    // We are assuming K and V tensors are of the same shape.
+    // We are assuming K and V tensors are of the same shape and type.
     TfLiteTensor* tensor = runner->input_tensor(k_cache_name.c_str());
-    size_t count = tensor->bytes / sizeof(float);
-    kv_cache.emplace(k_cache_name,
-                     std::vector<float, AlignedAllocator<float>>(count, 0.0f));
-    kv_cache.emplace(v_cache_name,
-                     std::vector<float, AlignedAllocator<float>>(count, 0.0f));
+    if (!IsValidKVCacheTensor(tensor, type)) {
+      LOG(ERROR) << k_cache_name << " is not a " << KVCacheTypeName(type)
+                 << " KV cache tensor, the model needs to be exported with a "
+                 << "matching KV cache type";
+      return {};
+    }
+    kv_cache.emplace(k_cache_name, kv_cache_t::mapped_type(tensor->bytes, 0));
+    kv_cache.emplace(v_cache_name, kv_cache_t::mapped_type(tensor->bytes, 0));
   }
 
   return kv_cache;
@@ -364,54 +570,74 @@ kv_cache_t LLMPipeline::BuildKVCache(tflite::Interpreter* interpreter) {
 
 void LLMPipeline::PrepareRunner(tflite::SignatureRunner* runner,
                                 kv_cache_t& kv_cache) {
+  MINIMAL_CHECK_VOID(BindKVCache(runner, kv_cache) == MLPERF_SUCCESS);
+  MINIMAL_CHECK_VOID(runner->AllocateTensors() == kTfLiteOk);
+}
+
+mlperf_status_t LLMPipeline::BindKVCache(tflite::SignatureRunner* runner,
+                                         kv_cache_t& kv_cache, size_t offset) {
   for (auto& [name, cache] : kv_cache) {
     TfLiteCustomAllocation allocation = {};
-    allocation.data = static_cast<void*>(cache.data());
-    allocation.bytes = cache.size() * sizeof(float);
+    allocation.data = static_cast<void*>(cache.data() + offset);
+    allocation.bytes = cache.size() - offset;
     // Both input and output tensors are set to the same buffer. Not all
     // delegates support this in-place update. For those cases, we need to do
     // a ping-pong buffer and update the pointers between inference calls.
-    MINIMAL_CHECK_VOID(runner->SetCustomAllocationForInputTensor(
-                           name.c_str(), allocation) == kTfLiteOk);
-    MINIMAL_CHECK_VOID(runner->SetCustomAllocationForOutputTensor(
-                           name.c_str(), allocation) == kTfLiteOk);
+    MINIMAL_CHECK(runner->SetCustomAllocationForInputTensor(
+                      name.c_str(), allocation) == kTfLiteOk);
+    MINIMAL_CHECK(runner->SetCustomAllocationForOutputTensor(
+                      name.c_str(), allocation) == kTfLiteOk);
   }
-  MINIMAL_CHECK_VOID(runner->AllocateTensors() == kTfLiteOk);
+  return MLPERF_SUCCESS;
 }
 
-tflite::SignatureRunner* LLMPipeline::GetPrefillRunner(
-    tflite::Interpreter* interpreter, std::size_t num_input_tokens,
-    kv_cache_t& kv_cache) {
-  // Find the prefill signature length that best matches the input token size.
-  tflite::SignatureRunner* runner = nullptr;
-  // int best_seq_size = -1;
-  size_t delta = std::numeric_limits<size_t>::max();
-  size_t max_prefill_size = 0;
-  std::string max_prefill_key = std::string("");
+std::map<size_t, tflite::SignatureRunner*> LLMPipeline::GetPrefillRunners(
+    tflite::Interpreter* interpreter, kv_cache_t& kv_cache) {
+  std::map<size_t, tflite::SignatureRunner*> runners;
   for (const std::string* key : interpreter->signature_keys()) {
     if (key->find("prefill") == std::string::npos) continue;
-    TfLiteTensor* input_pos = interpreter->GetSignatureRunner(key->c_str())
-                                  ->input_tensor("input_pos");
+    tflite::SignatureRunner* runner =
+        interpreter->GetSignatureRunner(key->c_str());
     // The expected shape for input position is [Seq].
-    size_t seq_size = input_pos->dims->data[0];
-    // TODO this could be else maybe?
-    if (seq_size > max_prefill_size) {
-      max_prefill_size = seq_size;
-      max_prefill_key = std::string(key->c_str());
-    }
-    if (num_input_tokens <= seq_size && seq_size - num_input_tokens < delta) {
-      runner = interpreter->GetSignatureRunner(key->c_str());
-      // best_seq_size = seq_size;
-      delta = seq_size - num_input_tokens;
+    size_t seq_size = runner->input_tensor("input_pos")->dims->data[0];
+    PrepareRunner(runner, kv_cache);
+    runners.emplace(seq_size, runner);
+  }
+  return runners;
+}
+
+tflite::SignatureRunner* LLMPipeline::GetPrefillRunner(
+    const std::map<size_t, tflite::SignatureRunner*>& runners,
+    std::size_t num_input_tokens) {
+  // Find the smallest prefill signature that fits the input token size, or
+  // fall back to the largest one.
+  auto it = runners.lower_bound(num_input_tokens);
+  if (it == runners.end()) --it;
+  return it->second;
+}
+
+mlperf_status_t LLMPipeline::InvokeMultiToken(tflite::SignatureRunner* runner,
+                                              const int* tokens, int count,
+                                              int position, int kv_cache_max) {
+  TfLiteTensor* input_pos_tensor = runner->input_tensor("input_pos");
+  int32_t* input = runner->input_tensor("tokens")->data.i32;
+  int32_t* input_pos = input_pos_tensor->data.i32;
+  // The expected shape for input position is [Seq].
+  int seq_size = input_pos_tensor->dims->data[0];
+  MINIMAL_CHECK(count <= seq_size);
+  for (int i = 0; i < seq_size; ++i) {
+    if (i < count) {
+      input[i] = tokens[i];
+      input_pos[i] = position + i;
+    } else {
+      // Padding is written to rows after the given tokens, which are written
+      // again before they are attended to.
+      input[i] = 128009;
+      input_pos[i] = std::min(position + i, kv_cache_max - 1);
     }
   }
-  // fallback to maximum possible size if a runner is not found (most likely
-  // because the seq_size is larger than max_prefill_size)
-  if (!runner && max_prefill_key != "")
-    runner = interpreter->GetSignatureRunner(max_prefill_key.c_str());
-  MINIMAL_CHECK_PTR(runner != nullptr);
-  PrepareRunner(runner, kv_cache);
-  return runner;
+  MINIMAL_CHECK(runner->Invoke() == kTfLiteOk);
+  return MLPERF_SUCCESS;
 }
 
 tflite::SignatureRunner* LLMPipeline::GetDecodeRunner(
@@ -422,18 +648,315 @@ tflite::SignatureRunner* LLMPipeline::GetDecodeRunner(
   return runner;
 }
 
-// A basic greedy sampler (equivalent to argmax).
-int LLMPipeline::GreedySampler(const TfLiteTensor* logits) {
-  float max_value = -std::numeric_limits<float>::infinity();
-  int max_index = 0;
+mlperf_status_t LLMPipeline::IssueBatchedQuery(LLMBackendData* backend_data,
+                                               ft_callback callback,
+                                               void* context) {
+  const std::vector<std::vector<int>>& prompts = backend_data->batch_prompts;
+  int num_prompts = static_cast<int>(prompts.size());
+  backend_data->batch_outputs.assign(num_prompts, {});
+  backend_data->sampler.Reset();
+
+  int32_t* tokens = backend_data->tensors.decode_input()->data.i32;
+  int32_t* positions = backend_data->tensors.decode_input_pos()->data.i32;
+  const TfLiteTensor* logits = backend_data->tensors.logits_output();
   // logits shape: [Batch, Seq, Vocab], Dtype: float
-  for (int i = 0; i < logits->dims->data[2]; ++i) {
-    if (logits->data.f[i] > max_value) {
-      max_value = logits->data.f[i];
-      max_index = i;
+  int vocab_size = logits->dims->data[2];
+  int kv_cache_max = backend_data->kv_cache_max;
+
+  std::vector<DecodeSlot> slots(backend_data->decode_batch);
+  int next_prompt = 0;
+  int active = 0;
+  bool first_token = true;
+  while (true) {
+    // Refill free slots from the queue. The last prompt token of a new
+    // sequence runs with the next batched decode, which produces its first
+    // output token.
+    for (int s = 0; s < backend_data->decode_batch && next_prompt < num_prompts;
+         ++s) {
+      if (slots[s].request >= 0) continue;
+      const std::vector<int>& prompt = prompts[next_prompt];
+      MINIMAL_CHECK(PrefillSlot(backend_data, s, prompt) == MLPERF_SUCCESS);
+      slots[s] = {next_prompt++, prompt.back(),
+                  static_cast<int>(prompt.size()) - 1};
+      ++active;
+    }
+    if (active == 0) break;
+
+    for (int s = 0; s < backend_data->decode_batch; ++s) {
+      if (slots[s].request >= 0) {
+        tokens[s] = slots[s].token;
+        positions[s] = slots[s].position;
+      } else {
+        // Free slots decode padding into the last row of their own slot,
+        // which is written again before it is attended to.
+        tokens[s] = 128009;
+        positions[s] = kv_cache_max - 1;
+      }
+    }
+    MINIMAL_CHECK(backend_data->decode_runner->Invoke() == kTfLiteOk);
+    if (first_token) {
+      callback(context);
+      first_token = false;
+    }
+
+    for (int s = 0; s < backend_data->decode_batch; ++s) {
+      DecodeSlot& slot = slots[s];
+      if (slot.request < 0) continue;
+      int token = backend_data->sampler.Sample(logits->data.f + s * vocab_size,
+                                               vocab_size);
+      std::vector<int>& output = backend_data->batch_outputs[slot.request];
+      bool stop = backend_data->stop_token_ids.count(token) > 0;
+      if (!stop) {
+        output.push_back(token);
+        stop = !StreamToken(backend_data, slot.request, token);
+      }
+      slot.token = token;
+      slot.position += 1;
+      if (stop ||
+          static_cast<int>(output.size()) >= backend_data->max_output_tokens ||
+          slot.position >= kv_cache_max) {
+        slot.request = -1;
+        --active;
+      }
+    }
+  }
+
+  backend_data->batch_prompts.clear();
+  return MLPERF_SUCCESS;
+}
+
+mlperf_status_t LLMPipeline::PrefillSlot(LLMBackendData* backend_data,
+                                         int slot,
+                                         const std::vector<int>& prompt) {
+  size_t last = prompt.size() - 1;
+  size_t position = 0;
+  while (position < last) {
+    tflite::SignatureRunner* runner =
+        GetPrefillRunner(backend_data->prefill_runners, last - position);
+    int& prepared_slot = backend_data->prefill_slots[runner];
+    if (prepared_slot != slot) {
+      MINIMAL_CHECK(BindKVCache(runner, backend_data->kv_cache,
+                                slot * backend_data->kv_cache_slot_size) ==
+                    MLPERF_SUCCESS);
+      prepared_slot = slot;
+    }
+    // The expected shape for input position is [Seq].
+    size_t seq_size = runner->input_tensor("input_pos")->dims->data[0];
+    size_t size = std::min(last - position, seq_size);
+    MINIMAL_CHECK(InvokeMultiToken(runner, &prompt[position],
+                                   static_cast<int>(size),
+                                   static_cast<int>(position),
+                                   backend_data->kv_cache_max) ==
+                  MLPERF_SUCCESS);
+    position += size;
+  }
+  return MLPERF_SUCCESS;
+}
+
+void LLMPipeline::ReusePromptPrefix(LLMBackendData* backend_data) {
+  const std::vector<int>& prompt = backend_data->prompt_tokens;
+  // The last prompt token always runs to produce the first output logits.
+  size_t limit = prompt.size() - 1;
+  auto common_prefix = [&prompt, limit](const std::vector<int>& tokens) {
+    size_t n = std::min(limit, tokens.size());
+    size_t k = 0;
+    while (k < n && tokens[k] == prompt[k]) ++k;
+    return k;
+  };
+
+  size_t best_prefix = common_prefix(backend_data->cached_tokens);
+  KVCacheSnapshot* best_snapshot = nullptr;
+  for (KVCacheSnapshot& snapshot : backend_data->prefix_snapshots) {
+    size_t k = common_prefix(snapshot.tokens);
+    if (k > best_prefix) {
+      best_prefix = k;
+      best_snapshot = &snapshot;
     }
   }
-  return max_index;
+
+  if (best_snapshot == nullptr) {
+    // The rows of the shared prefix are valid in the KV cache already. Keep a
+    // copy since the following rows are about to be overwritten and the
+    // prefix is likely shared with later prompts too.
+    SnapshotPrefix(backend_data, best_prefix);
+  } else {
+    size_t size = best_prefix * backend_data->kv_cache_row_size;
+    for (auto& [name, cache] : backend_data->kv_cache) {
+      const auto& rows = best_snapshot->kv_cache.at(name);
+      std::copy(rows.begin(), rows.begin() + size, cache.begin());
+    }
+    best_snapshot->last_used = backend_data->query_counter;
+  }
+
+  backend_data->reused_prefix = static_cast<int>(best_prefix);
+  backend_data->cached_tokens.assign(prompt.begin(),
+                                     prompt.begin() + best_prefix);
+}
+
+void LLMPipeline::SnapshotPrefix(LLMBackendData* backend_data,
+                                 size_t prefix_size) {
+  if (backend_data->max_prefix_snapshots <= 0 ||
+      prefix_size < kMinSnapshotTokens) {
+    return;
+  }
+  std::vector<int> tokens(backend_data->cached_tokens.begin(),
+                          backend_data->cached_tokens.begin() + prefix_size);
+  size_t fingerprint = std::hash<std::string_view>()(
+      std::string_view(reinterpret_cast<const char*>(tokens.data()),
+                       tokens.size() * sizeof(int)));
+
+  auto& snapshots = backend_data->prefix_snapshots;
+  for (KVCacheSnapshot& snapshot : snapshots) {
+    if (snapshot.fingerprint == fingerprint && snapshot.tokens == tokens) {
+      snapshot.last_used = backend_data->query_counter;
+      return;
+    }
+  }
+  if (snapshots.size() >=
+      static_cast<size_t>(backend_data->max_prefix_snapshots)) {
+    snapshots.erase(std::min_element(
+        snapshots.begin(), snapshots.end(),
+        [](const KVCacheSnapshot& a, const KVCacheSnapshot& b) {
+          return a.last_used < b.last_used;
+        }));
+  }
+
+  KVCacheSnapshot snapshot;
+  snapshot.tokens = std::move(tokens);
+  snapshot.fingerprint = fingerprint;
+  snapshot.last_used = backend_data->query_counter;
+  size_t size = prefix_size * backend_data->kv_cache_row_size;
+  for (auto& [name, cache] : backend_data->kv_cache) {
+    snapshot.kv_cache.emplace(
+        name, kv_cache_t::mapped_type(cache.begin(), cache.begin() + size));
+  }
+  snapshots.push_back(std::move(snapshot));
+}
+
+DraftModel* LLMPipeline::LoadDraftModel(const std::string& path,
+                                        int num_threads,
+                                        KVCacheType kv_cache_type) {
+  DraftModel* draft = new DraftModel();
+  draft->model = tflite::FlatBufferModel::BuildFromFile(path.c_str()).release();
+  if (draft->model) {
+    draft->interpreter = BuildInterpreter(draft->model, num_threads);
+  }
+  if (draft->interpreter) {
+    draft->kv_cache = BuildKVCache(draft->interpreter, kv_cache_type);
+  }
+  if (!draft->kv_cache.empty()) {
+    draft->decode_runner = GetDecodeRunner(draft->interpreter, draft->kv_cache);
+    draft->prefill_runners =
+        GetPrefillRunners(draft->interpreter, draft->kv_cache);
+  }
+  if (!draft->decode_runner || draft->prefill_runners.empty()) {
+    delete draft;
+    return nullptr;
+  }
+  draft->kv_cache_max =
+      draft->decode_runner->input_tensor("kv_cache_k_0")->dims->data[1];
+  return draft;
+}
+
+int LLMPipeline::DraftNextToken(DraftModel* draft,
+                                const std::vector<int>& context) {
+  // Keep the rows of the longest common prefix. The last token always runs to
+  // produce the logits.
+  size_t last = context.size() - 1;
+  size_t position = 0;
+  size_t limit = std::min(last, draft->cached_tokens.size());
+  while (position < limit &&
+         draft->cached_tokens[position] == context[position]) {
+    ++position;
+  }
+  draft->cached_tokens.resize(position);
+
+  while (position < last) {
+    tflite::SignatureRunner* runner =
+        GetPrefillRunner(draft->prefill_runners, last - position);
+    // The expected shape for input position is [Seq].
+    size_t seq_size = runner->input_tensor("input_pos")->dims->data[0];
+    size_t size = std::min(last - position, seq_size);
+    if (InvokeMultiToken(runner, &context[position], static_cast<int>(size),
+                         static_cast<int>(position),
+                         draft->kv_cache_max) != MLPERF_SUCCESS) {
+      return -1;
+    }
+    draft->cached_tokens.insert(draft->cached_tokens.end(),
+                                context.begin() + position,
+                                context.begin() + position + size);
+    position += size;
+  }
+
+  tflite::SignatureRunner* runner = draft->decode_runner;
+  runner->input_tensor("tokens")->data.i32[0] = context[last];
+  runner->input_tensor("input_pos")->data.i32[0] = last;
+  if (runner->Invoke() != kTfLiteOk) return -1;
+  draft->cached_tokens.push_back(context[last]);
+  const TfLiteTensor* logits = runner->output_tensor("logits");
+  // logits shape: [Batch, Seq, Vocab], Dtype: float
+  return ArgMax(logits->data.f, logits->dims->data[2]);
+}
+
+mlperf_status_t LLMPipeline::SpeculateTokens(LLMBackendData* backend_data,
+                                             int token, int position,
+                                             int num_proposals,
+                                             std::vector<int>* tokens) {
+  MINIMAL_CHECK(static_cast<int>(backend_data->cached_tokens.size()) ==
+                position);
+  // The draft proposes autoregressively from the target's context.
+  std::vector<int> context = backend_data->cached_tokens;
+  context.push_back(token);
+  std::vector<int> candidates{token};
+  for (int i = 0; i < num_proposals; ++i) {
+    int proposal = DraftNextToken(backend_data->draft, context);
+    MINIMAL_CHECK(proposal >= 0);
+    context.push_back(proposal);
+    candidates.push_back(proposal);
+  }
+
+  // Score all candidates with a single target invocation. Row i of the
+  // logits predicts the token after candidates[i].
+  int num_candidates = static_cast<int>(candidates.size());
+  MINIMAL_CHECK(InvokeMultiToken(backend_data->verify_runner, candidates.data(),
+                                 num_candidates, position,
+                                 backend_data->kv_cache_max) == MLPERF_SUCCESS);
+  const TfLiteTensor* logits =
+      backend_data->verify_runner->output_tensor("logits");
+  // logits shape: [Batch, Seq, Vocab], Dtype: float
+  int vocab_size = logits->dims->data[2];
+  int accepted = 0;
+  int target_token = ArgMax(logits->data.f, vocab_size);
+  while (accepted < num_proposals && target_token == candidates[accepted + 1]) {
+    ++accepted;
+    target_token = ArgMax(logits->data.f + accepted * vocab_size, vocab_size);
+  }
+
+  // Rows of rejected candidates are left behind. Like any row past the cached
+  // tokens, they are masked out and written again before being attended to.
+  backend_data->cached_tokens.insert(backend_data->cached_tokens.end(),
+                                     candidates.begin(),
+                                     candidates.begin() + accepted + 1);
+  tokens->assign(candidates.begin() + 1, candidates.begin() + accepted + 1);
+  tokens->push_back(target_token);
+  backend_data->proposed_tokens += num_proposals;
+  backend_data->accepted_tokens += accepted;
+  backend_data->query_proposed_tokens += num_proposals;
+  backend_data->query_accepted_tokens += accepted;
+  return MLPERF_SUCCESS;
+}
+
+bool LLMPipeline::StreamToken(LLMBackendData* backend_data, int batch_index,
+                              int token) {
+  if (!backend_data->on_token) return true;
+  return backend_data->on_token(backend_data->on_token_context, batch_index,
+                                token);
+}
+
+int LLMPipeline::SampleNextToken(LLMBackendData* backend_data) {
+  const TfLiteTensor* logits = backend_data->tensors.logits_output();
+  // logits shape: [Batch, Seq, Vocab], Dtype: float
+  return backend_data->sampler.Sample(logits->data.f, logits->dims->data[2]);
 }
 
 #ifdef __cplusplus
@@ -18,6 +18,9 @@ limitations under the License.
 
 #include <stdlib.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <map>
 #include <string>
 #include <unordered_set>
@@ -28,7 +31,9 @@ limitations under the License.
 #endif
 
 #include "flutter/cpp/c/type.h"
+#include "kv_cache_utils.h"
 #include "pipeline.h"
+#include "sampler.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/lite/experimental/genai/genai_ops.h"
 #include "tensorflow/lite/interpreter.h"
@@ -90,24 +95,51 @@ class AlignedAllocator {
   }
 };
 
+// Raw KV cache buffers by tensor name. The element type follows the
+// kv_cache_type setting, see kv_cache_utils.h.
 using kv_cache_t =
-    std::map<std::string, std::vector<float, AlignedAllocator<float>>>;
+    std::map<std::string, std::vector<uint8_t, AlignedAllocator<uint8_t>>>;
+
+// A copy of the KV cache rows of a token prefix. Prompts starting with the
+// same tokens copy these rows back instead of prefilling them again.
+struct KVCacheSnapshot {
+  std::vector<int> tokens;
+  // Hash of tokens, used to avoid storing the same prefix twice.
+  size_t fingerprint = 0;
+  // Rows [0, tokens.size()) of every KV cache tensor.
+  kv_cache_t kv_cache;
+  // Value of LLMBackendData::query_counter when the snapshot was last used.
+  uint64_t last_used = 0;
+};
+
+// One invocation of a prefill signature, covering `size` prompt tokens.
+struct PrefillChunk {
+  tflite::SignatureRunner *runner;
+  int size;
+};
+
+// A sequence decoded in continuous batching mode. It occupies one batch row
+// of the decode signature and the matching slot of the KV cache.
+struct DecodeSlot {
+  // Index of the prompt in the batch, -1 when the slot is free.
+  int request = -1;
+  // Token to decode next and its position.
+  int token = 0;
+  int position = 0;
+};
 
 // A simple container for pointers to the tensors used during inference.
 // The pointers here should not be managed or deleted by this struct.
 struct LLMTensors {
-  bool get_tensors(tflite::SignatureRunner *prefill_runner,
-                   tflite::SignatureRunner *decode_runner) {
-    prefill_input_ = prefill_runner->input_tensor("tokens");
-    prefill_input_pos_ = prefill_runner->input_tensor("input_pos");
+  bool get_tensors(tflite::SignatureRunner *decode_runner) {
     decode_input_ = decode_runner->input_tensor("tokens");
     decode_input_pos_ = decode_runner->input_tensor("input_pos");
     logits_output_ = decode_runner->output_tensor("logits");
     kv_cache_k_0_ = decode_runner->input_tensor("kv_cache_k_0");
 
     // Making sure none of the tensors are nullptr.
-    return prefill_input_ && prefill_input_pos_ && decode_input_ &&
-           decode_input_pos_ && logits_output_ && kv_cache_k_0_;
+    return decode_input_ && decode_input_pos_ && logits_output_ &&
+           kv_cache_k_0_;
   }
 
   LLMTensors() {}
@@ -115,18 +147,12 @@ struct LLMTensors {
   LLMTensors(const LLMTensors &) = delete;
   LLMTensors &operator=(const LLMTensors &) = delete;
 
-  TfLiteTensor *prefill_input() const { return prefill_input_; }
-  TfLiteTensor *prefill_input_pos() const { return prefill_input_pos_; }
   TfLiteTensor *decode_input() const { return decode_input_; }
   TfLiteTensor *decode_input_pos() const { return decode_input_pos_; }
   const TfLiteTensor *logits_output() const { return logits_output_; }
   TfLiteTensor *kv_cache_k_0() const { return kv_cache_k_0_; }
 
  private:
-  // Shape: [Batch, Seq], Dtype: int32
-  TfLiteTensor *prefill_input_;
-  // Shape: [Seq], Dtype: int32
-  TfLiteTensor *prefill_input_pos_;
   // Shape: [Batch, Seq], Dtype: int32
   TfLiteTensor *decode_input_;
   // Shape: [Seq], Dtype: int32
@@ -137,6 +163,60 @@ struct LLMTensors {
   TfLiteTensor *kv_cache_k_0_;
 };
 
+// Ring of token timestamps for the token latency report, allocated once.
+// Holds the query start followed by one timestamp per output token.
+class TokenTimestampRing {
+ public:
+  void Allocate(size_t capacity) { timestamps_.assign(capacity, 0); }
+  void Clear() { count_ = 0; }
+
+  void Record() {
+    if (timestamps_.empty()) return;
+    timestamps_[count_++ % timestamps_.size()] =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+  }
+
+  // Copies the last recorded timestamps in order, at most capacity of them.
+  int32_t CopyTo(int64_t *timestamps_ns, int32_t capacity) const {
+    size_t n = std::min({count_, timestamps_.size(),
+                         static_cast<size_t>(std::max(capacity, 0))});
+    size_t start = count_ - n;
+    for (size_t i = 0; i < n; ++i) {
+      timestamps_ns[i] = timestamps_[(start + i) % timestamps_.size()];
+    }
+    return static_cast<int32_t>(n);
+  }
+
+ private:
+  std::vector<int64_t> timestamps_;
+  size_t count_ = 0;
+};
+
+// Smaller model proposing tokens for speculative decoding. It has its own
+// KV cache, which follows the tokens accepted by the target model.
+struct DraftModel {
+  tflite::FlatBufferModel *model{nullptr};
+  tflite::Interpreter *interpreter{nullptr};
+  std::map<size_t, tflite::SignatureRunner *> prefill_runners;
+  tflite::SignatureRunner *decode_runner{nullptr};
+  kv_cache_t kv_cache;
+  int kv_cache_max = 0;
+  // Tokens whose KV cache rows are valid, in position order.
+  std::vector<int> cached_tokens;
+
+  DraftModel() {}
+
+  ~DraftModel() {
+    delete interpreter;
+    delete model;
+  }
+
+  DraftModel(const DraftModel &) = delete;
+  DraftModel &operator=(const DraftModel &) = delete;
+};
+
 struct LLMBackendData {
   const char *name = "TFLite";
   const char *vendor = "Google";
@@ -145,10 +225,50 @@ struct LLMBackendData {
   // TfLiteInterpreterOptions *options{}; TODO use this to allow different
   // delegates other than CPU?
   tflite::Interpreter *interpreter{};
-  tflite::SignatureRunner *prefill_runner{nullptr};
+  // Prefill runners prepared at creation, keyed by their sequence length.
+  std::map<size_t, tflite::SignatureRunner *> prefill_runners;
+  // Prefill invocations for the prompt tokens after reused_prefix, in order.
+  std::vector<PrefillChunk> prefill_chunks;
   tflite::SignatureRunner *decode_runner{nullptr};
   LLMTensors tensors;
   kv_cache_t kv_cache;
+  KVCacheType kv_cache_type = KVCacheType::kFloat32;
+  // Number of positions in the KV cache and number of bytes per position.
+  int kv_cache_max = 0;
+  size_t kv_cache_row_size = 0;
+  // Tokens whose KV cache rows are valid, in position order.
+  std::vector<int> cached_tokens;
+  // Number of leading prompt tokens whose KV cache rows are reused.
+  int reused_prefix = 0;
+  std::vector<KVCacheSnapshot> prefix_snapshots;
+  // Maximum number of prefix snapshots, set with the prefix_cache_size
+  // setting. 0 only reuses the prefix of the previous query.
+  int max_prefix_snapshots = 1;
+  uint64_t query_counter = 0;
+  Sampler sampler;
+  // Speculative decoding, enabled by the draft_model_filename setting. The
+  // verify signature scores draft_tokens proposals in a single invocation.
+  DraftModel *draft{nullptr};
+  tflite::SignatureRunner *verify_runner{nullptr};
+  int draft_tokens = 0;
+  uint64_t proposed_tokens = 0;
+  uint64_t accepted_tokens = 0;
+  // The same counts for the last query only.
+  uint64_t query_proposed_tokens = 0;
+  uint64_t query_accepted_tokens = 0;
+  TokenTimestampRing token_timestamps;
+  // Receives every output token, see backend_set_token_callback.
+  token_callback on_token{nullptr};
+  void *on_token_context{nullptr};
+  // Continuous batching, used when the decode signature is exported with a
+  // batch size above 1. Prompts set at different batch indexes are queued
+  // and decoded together, each in its own batch row of the KV cache.
+  int decode_batch = 1;
+  size_t kv_cache_slot_size = 0;
+  // KV cache slot each prefill runner currently writes to.
+  std::map<tflite::SignatureRunner *, int> prefill_slots;
+  std::vector<std::vector<int>> batch_prompts;
+  std::vector<std::vector<int>> batch_outputs;
   std::vector<int> prompt_tokens;
   std::vector<int> output_tokens;
   uint16_t num_threads = 4;
@@ -159,6 +279,7 @@ struct LLMBackendData {
 
   ~LLMBackendData() {
     // Runners are owned by interpreter and therefore don't need to be deleted
+    delete draft;
     delete interpreter;
     delete model;
   }
@@ -221,6 +342,18 @@ class LLMPipeline : public Pipeline {
   void backend_convert_outputs(mlperf_backend_ptr_t backend_ptr, int bytes,
                                int width, int height, uint8_t *data) override;
 
+  int32_t backend_get_token_timestamps(mlperf_backend_ptr_t backend_ptr,
+                                       int64_t *timestamps_ns,
+                                       int32_t capacity) override;
+
+  mlperf_status_t backend_get_draft_token_counts(
+      mlperf_backend_ptr_t backend_ptr, int64_t *proposed,
+      int64_t *accepted) override;
+
+  mlperf_status_t backend_set_token_callback(mlperf_backend_ptr_t backend_ptr,
+                                             token_callback callback,
+                                             void *context) override;
+
   void *backend_get_buffer(size_t n) override;
 
   void backend_release_buffer(void *p) override;
@@ -228,14 +361,57 @@ class LLMPipeline : public Pipeline {
  private:
   tflite::Interpreter *BuildInterpreter(tflite::FlatBufferModel *model,
                                         int num_threads);
-  kv_cache_t BuildKVCache(tflite::Interpreter *interpreter);
+  kv_cache_t BuildKVCache(tflite::Interpreter *interpreter, KVCacheType type);
+  // Points the KV cache tensors of runner to the buffers of kv_cache and
+  // allocates the remaining tensors.
   void PrepareRunner(tflite::SignatureRunner *runner, kv_cache_t &kv_cache);
-  tflite::SignatureRunner *GetPrefillRunner(tflite::Interpreter *interpreter,
-                                            std::size_t num_input_tokens,
-                                            kv_cache_t &kv_cache);
+  // Points the KV cache tensors of an already prepared runner to the buffers
+  // of kv_cache, starting `offset` bytes into each of them. The tensor shapes
+  // do not change, so the runner does not need to be allocated again.
+  mlperf_status_t BindKVCache(tflite::SignatureRunner *runner,
+                              kv_cache_t &kv_cache, size_t offset = 0);
+  // Prepares every prefill signature, keyed by its sequence length.
+  std::map<size_t, tflite::SignatureRunner *> GetPrefillRunners(
+      tflite::Interpreter *interpreter, kv_cache_t &kv_cache);
+  // Returns the smallest prefill runner fitting num_input_tokens, or the
+  // largest one if none does.
+  tflite::SignatureRunner *GetPrefillRunner(
+      const std::map<size_t, tflite::SignatureRunner *> &runners,
+      std::size_t num_input_tokens);
+  // Runs `count` tokens at consecutive positions from `position` through a
+  // prefill-style runner, padding the rest of its sequence.
+  mlperf_status_t InvokeMultiToken(tflite::SignatureRunner *runner,
+                                   const int *tokens, int count, int position,
+                                   int kv_cache_max);
   tflite::SignatureRunner *GetDecodeRunner(tflite::Interpreter *interpreter,
                                            kv_cache_t &kv_cache);
-  int GreedySampler(const TfLiteTensor *logits);
+  // Passes an output token to the token callback. Returns false if the query
+  // in batch_index should stop generating.
+  bool StreamToken(LLMBackendData *backend_data, int batch_index, int token);
+  // Samples the next token from the decode logits.
+  int SampleNextToken(LLMBackendData *backend_data);
+  DraftModel *LoadDraftModel(const std::string &path, int num_threads,
+                             KVCacheType kv_cache_type);
+  // Brings the draft KV cache in line with `context` and returns the token
+  // the draft predicts after it, or -1 on failure.
+  int DraftNextToken(DraftModel *draft, const std::vector<int> &context);
+  // Proposes num_proposals draft tokens after `token`, which sits at
+  // `position`, and verifies them with the target model. Fills `tokens` with
+  // the accepted proposals followed by the target's own next token.
+  mlperf_status_t SpeculateTokens(LLMBackendData *backend_data, int token,
+                                  int position, int num_proposals,
+                                  std::vector<int> *tokens);
+  // Decodes every queued prompt, keeping decode_batch sequences in flight and
+  // refilling the slots of finished sequences from the queue.
+  mlperf_status_t IssueBatchedQuery(LLMBackendData *backend_data,
+                                    ft_callback callback, void *context);
+  // Prefills all but the last prompt token into the given KV cache slot.
+  mlperf_status_t PrefillSlot(LLMBackendData *backend_data, int slot,
+                              const std::vector<int> &prompt);
+  // Finds the longest reusable prefix of the prompt, restoring it from a
+  // snapshot if needed, and sets reused_prefix.
+  void ReusePromptPrefix(LLMBackendData *backend_data);
+  void SnapshotPrefix(LLMBackendData *backend_data, size_t prefix_size);
 };
 
 #endif  // TFLITE_SINGLE_MODEL_PIPELINE_H_
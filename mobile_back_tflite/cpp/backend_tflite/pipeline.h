@@ -83,6 +83,33 @@ class Pipeline {
                                        int bytes, int width, int height,
                                        uint8_t *data) = 0;
 
+  // Optional function to use data as the storage of the ith input.
+  virtual mlperf_status_t backend_bind_input(mlperf_backend_ptr_t backend_ptr,
+                                             int32_t batch_index, int32_t i,
+                                             void *data) {
+    return MLPERF_FAILURE;
+  }
+
+  // Optional function to report the token timestamps of the last query.
+  virtual int32_t backend_get_token_timestamps(mlperf_backend_ptr_t backend_ptr,
+                                               int64_t *timestamps_ns,
+                                               int32_t capacity) {
+    return 0;
+  }
+
+  // Optional function to report the draft token counts of the last query.
+  virtual mlperf_status_t backend_get_draft_token_counts(
+      mlperf_backend_ptr_t backend_ptr, int64_t *proposed, int64_t *accepted) {
+    return MLPERF_FAILURE;
+  }
+
+  // Optional function to stream the output tokens of the following queries.
+  virtual mlperf_status_t backend_set_token_callback(
+      mlperf_backend_ptr_t backend_ptr, token_callback callback,
+      void *context) {
+    return MLPERF_FAILURE;
+  }
+
   virtual void *backend_get_buffer(size_t n) = 0;
 
   virtual void backend_release_buffer(void *p) = 0;
@@ -0,0 +1,147 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+int ArgMax(const float* data, int size) {
+  int max_index = 0;
+  float max_value = data[0];
+  int i = 0;
+  // Only blocks holding a value above the current maximum are scanned again.
+#if defined(__AVX2__)
+  constexpr int kBlockSize = 8;
+  for (; i + kBlockSize <= size; i += kBlockSize) {
+    __m256 block = _mm256_loadu_ps(data + i);
+    __m256 greater =
+        _mm256_cmp_ps(block, _mm256_set1_ps(max_value), _CMP_GT_OQ);
+    if (_mm256_movemask_ps(greater) == 0) continue;
+    for (int j = i; j < i + kBlockSize; ++j) {
+      if (data[j] > max_value) {
+        max_value = data[j];
+        max_index = j;
+      }
+    }
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  constexpr int kBlockSize = 16;
+  for (; i + kBlockSize <= size; i += kBlockSize) {
+    float32x4_t block_max =
+        vmaxq_f32(vmaxq_f32(vld1q_f32(data + i), vld1q_f32(data + i + 4)),
+                  vmaxq_f32(vld1q_f32(data + i + 8), vld1q_f32(data + i + 12)));
+    if (vmaxvq_f32(block_max) <= max_value) continue;
+    for (int j = i; j < i + kBlockSize; ++j) {
+      if (data[j] > max_value) {
+        max_value = data[j];
+        max_index = j;
+      }
+    }
+  }
+#endif
+  // Leftover loop.
+  for (; i < size; ++i) {
+    if (data[i] > max_value) {
+      max_value = data[i];
+      max_index = i;
+    }
+  }
+  return max_index;
+}
+
+namespace {
+
+// Candidates ordered at a time when nucleus filtering without top_k, doubled
+// until the nucleus is found. The nucleus is usually a small part of the
+// vocabulary.
+constexpr int kNucleusChunk = 64;
+
+}  // namespace
+
+int Sampler::Sample(const float* logits, int vocab_size) {
+  if (IsGreedy()) return ArgMax(logits, vocab_size);
+
+  candidates_.resize(vocab_size);
+  for (int i = 0; i < vocab_size; ++i) {
+    candidates_[i] = {logits[i], i};
+  }
+  // Softmax with temperature, relative to the largest logit for stability.
+  const float max_logit = logits[ArgMax(logits, vocab_size)];
+  auto probability = [&](int i) {
+    return std::exp((candidates_[i].first - max_logit) / params_.temperature);
+  };
+
+  // Only the candidates needed by top_k and top_p are ordered, so sampling
+  // without them stays linear in the vocabulary size.
+  int k = vocab_size;
+  int ordered = 0;
+  if (params_.top_k > 0) {
+    k = std::min(params_.top_k, vocab_size);
+    OrderCandidates(0, k);
+    ordered = k;
+  }
+  probabilities_.resize(k);
+  double sum = 0.0;
+  for (int i = 0; i < k; ++i) {
+    probabilities_[i] = probability(i);
+    sum += probabilities_[i];
+  }
+
+  // Nucleus filtering: keep the smallest prefix reaching top_p of the mass.
+  if (params_.top_p < 1.0f) {
+    double threshold = params_.top_p * sum;
+    double cumulative = 0.0;
+    int kept = 0;
+    int chunk = kNucleusChunk;
+    while (kept < k && cumulative < threshold) {
+      if (kept == ordered) {
+        int end = std::min(k, ordered + chunk);
+        OrderCandidates(ordered, end);
+        for (int i = ordered; i < end; ++i) probabilities_[i] = probability(i);
+        ordered = end;
+        chunk *= 2;
+      }
+      cumulative += probabilities_[kept++];
+    }
+    k = std::max(kept, 1);
+    sum = cumulative > 0.0 ? cumulative : probabilities_[0];
+  }
+
+  double r = std::uniform_real_distribution<double>(0.0, sum)(rng_);
+  for (int i = 0; i < k; ++i) {
+    r -= probabilities_[i];
+    if (r < 0.0) return candidates_[i].second;
+  }
+  return candidates_[k - 1].second;
+}
+
+void Sampler::OrderCandidates(int begin, int end) {
+  auto greater = [](const std::pair<float, int>& a,
+                    const std::pair<float, int>& b) {
+    return a.first > b.first;
+  };
+  if (end < static_cast<int>(candidates_.size())) {
+    std::nth_element(candidates_.begin() + begin, candidates_.begin() + end,
+                     candidates_.end(), greater);
+  }
+  std::sort(candidates_.begin() + begin, candidates_.begin() + end, greater);
+}
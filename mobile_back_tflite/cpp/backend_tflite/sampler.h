@@ -0,0 +1,68 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TFLITE_SAMPLER_H_
+#define TFLITE_SAMPLER_H_
+
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+// Index of the largest value, the first one on ties. Vectorized with NEON on
+// aarch64 and with AVX2 when the target supports it.
+int ArgMax(const float *data, int size);
+
+// Set with the sampler_temperature, sampler_top_k, sampler_top_p and
+// sampler_seed custom settings. The defaults are greedy decoding.
+struct SamplerParams {
+  // Logits are divided by temperature before the softmax. 0 picks the argmax.
+  float temperature = 0.0f;
+  // Only the top_k most likely tokens are kept. 0 keeps all of them.
+  int top_k = 0;
+  // Only the most likely tokens whose probabilities add up to top_p are kept.
+  float top_p = 1.0f;
+  uint64_t seed = 0;
+};
+
+// Picks the next token from the logits of the last position.
+class Sampler {
+ public:
+  explicit Sampler(const SamplerParams &params = SamplerParams())
+      : params_(params), rng_(params.seed) {}
+
+  // Restarts the random sequence from the seed, so that the output of a query
+  // does not depend on the queries issued before it.
+  void Reset() { rng_.seed(params_.seed); }
+
+  bool IsGreedy() const {
+    return params_.temperature <= 0.0f || params_.top_k == 1;
+  }
+
+  int Sample(const float *logits, int vocab_size);
+
+ private:
+  // Moves the largest end - begin candidates after begin to [begin, end), in
+  // descending order. The candidates before begin must already be ordered.
+  void OrderCandidates(int begin, int end);
+
+  SamplerParams params_;
+  std::mt19937_64 rng_;
+  // Scratch buffers reused across tokens.
+  std::vector<std::pair<float, int>> candidates_;
+  std::vector<double> probabilities_;
+};
+
+#endif  // TFLITE_SAMPLER_H_
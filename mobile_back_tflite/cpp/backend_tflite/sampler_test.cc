@@ -0,0 +1,160 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using ::testing::Each;
+using ::testing::ElementsAre;
+using ::testing::Lt;
+using ::testing::UnorderedElementsAre;
+
+// Tokens drawn from `sampler` in `draws` calls on the same logits.
+std::vector<int> Draw(Sampler* sampler, const std::vector<float>& logits,
+                      int draws) {
+  std::vector<int> tokens;
+  for (int i = 0; i < draws; ++i) {
+    tokens.push_back(sampler->Sample(logits.data(), logits.size()));
+  }
+  return tokens;
+}
+
+TEST(ArgMax, PicksFirstOnTies) {
+  std::vector<float> logits = {1.0f, 3.0f, 2.0f, 3.0f};
+  EXPECT_EQ(ArgMax(logits.data(), logits.size()), 1);
+}
+
+TEST(ArgMax, PicksFirstOnTiesAcrossBlocks) {
+  // Long enough for the vectorized blocks and the leftover loop.
+  std::vector<float> logits(53, -1.0f);
+  logits[7] = 5.0f;
+  logits[20] = 5.0f;
+  logits[52] = 5.0f;
+  EXPECT_EQ(ArgMax(logits.data(), logits.size()), 7);
+  logits[7] = 4.0f;
+  EXPECT_EQ(ArgMax(logits.data(), logits.size()), 20);
+  logits[20] = 4.0f;
+  EXPECT_EQ(ArgMax(logits.data(), logits.size()), 52);
+}
+
+TEST(Sampler, GreedyByDefault) {
+  Sampler sampler;
+  EXPECT_TRUE(sampler.IsGreedy());
+  std::vector<float> logits = {0.5f, 2.0f, 2.0f, -1.0f};
+  EXPECT_THAT(Draw(&sampler, logits, 3), ElementsAre(1, 1, 1));
+}
+
+TEST(Sampler, TopKOneIsGreedy) {
+  SamplerParams params;
+  params.temperature = 1.0f;
+  params.top_k = 1;
+  Sampler sampler(params);
+  EXPECT_TRUE(sampler.IsGreedy());
+  std::vector<float> logits = {0.5f, 0.0f, 2.0f, -1.0f};
+  EXPECT_THAT(Draw(&sampler, logits, 3), ElementsAre(2, 2, 2));
+}
+
+TEST(Sampler, TopKKeepsMostLikelyTokens) {
+  SamplerParams params;
+  params.temperature = 1.0f;
+  params.top_k = 2;
+  Sampler sampler(params);
+  std::vector<float> logits = {1.0f, 1.2f, 0.9f, 1.1f, 0.0f};
+  std::vector<int> tokens = Draw(&sampler, logits, 200);
+  EXPECT_THAT(std::set<int>(tokens.begin(), tokens.end()),
+              UnorderedElementsAre(1, 3));
+}
+
+TEST(Sampler, TopPKeepsSmallestNucleus) {
+  SamplerParams params;
+  params.temperature = 1.0f;
+  params.top_p = 0.5f;
+  Sampler sampler(params);
+  // Softmax probabilities of about 0.42, 0.42, 0.16 and 0.0004, so two
+  // tokens are needed to reach top_p.
+  std::vector<float> logits = {2.0f, -6.0f, 1.0f, 2.0f};
+  std::vector<int> tokens = Draw(&sampler, logits, 200);
+  EXPECT_THAT(std::set<int>(tokens.begin(), tokens.end()),
+              UnorderedElementsAre(0, 3));
+
+  // A single token holding the mass is always picked.
+  params.top_p = 0.9f;
+  Sampler nucleus(params);
+  std::vector<float> peaked = {0.0f, 10.0f, 0.0f, 0.0f};
+  std::vector<int> peaked_tokens = Draw(&nucleus, peaked, 50);
+  EXPECT_THAT(std::set<int>(peaked_tokens.begin(), peaked_tokens.end()),
+              ElementsAre(1));
+}
+
+TEST(Sampler, TopPGrowsNucleusOverLargeVocabulary) {
+  SamplerParams params;
+  params.temperature = 1.0f;
+  params.top_p = 0.5f;
+  Sampler sampler(params);
+  // Slowly decreasing logits, so the nucleus holds hundreds of tokens and
+  // takes several ordering rounds.
+  std::vector<float> logits(4096);
+  for (size_t i = 0; i < logits.size(); ++i) logits[i] = -0.001f * i;
+  std::vector<double> probabilities(logits.size());
+  double sum = 0.0;
+  for (size_t i = 0; i < logits.size(); ++i) {
+    probabilities[i] = std::exp(logits[i]);
+    sum += probabilities[i];
+  }
+  int nucleus = 0;
+  for (double cumulative = 0.0; cumulative < 0.5 * sum;) {
+    cumulative += probabilities[nucleus++];
+  }
+  ASSERT_GT(nucleus, 256);
+
+  std::vector<int> tokens = Draw(&sampler, logits, 2000);
+  EXPECT_THAT(tokens, Each(Lt(nucleus)));
+  EXPECT_GT(*std::max_element(tokens.begin(), tokens.end()), nucleus / 2);
+}
+
+TEST(Sampler, ReproducesSeededSequences) {
+  SamplerParams params;
+  params.temperature = 1.0f;
+  params.seed = 42;
+  std::vector<float> logits = {0.1f, 0.2f, 0.3f, 0.4f, 0.5f, 0.6f};
+
+  Sampler first(params);
+  Sampler second(params);
+  std::vector<int> tokens = Draw(&first, logits, 50);
+  EXPECT_EQ(Draw(&second, logits, 50), tokens);
+  // Reset restarts from the seed.
+  first.Reset();
+  EXPECT_EQ(Draw(&first, logits, 50), tokens);
+
+  // Another seed gives another sequence.
+  params.seed = 43;
+  Sampler other(params);
+  EXPECT_NE(Draw(&other, logits, 50), tokens);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
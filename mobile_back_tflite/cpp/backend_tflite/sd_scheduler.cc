@@ -0,0 +1,203 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "sd_scheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+#include "tensorflow/core/platform/logging.h"
+
+namespace {
+
+constexpr int kTrainTimesteps = 1000;
+
+// Evenly spaced timesteps starting at 1, as used for the precomputed
+// timestep embeddings.
+std::vector<int> leading_timesteps(int num_steps) {
+  std::vector<int> timesteps(num_steps);
+  for (int i = 0; i < num_steps; ++i) {
+    timesteps[i] = i * (kTrainTimesteps / num_steps) + 1;
+  }
+  return timesteps;
+}
+
+// DDIM with eta = 0:
+//   x0 = (x - sqrt(1 - a_t) * e) / sqrt(a_t)
+//   x_prev = sqrt(a_prev) * x0 + sqrt(1 - a_prev) * e
+SchedulerStep ddim_step(float a_t, float a_prev) {
+  SchedulerStep step;
+  step.latent_scale = std::sqrt(a_prev) / std::sqrt(a_t);
+  step.noise_scale =
+      std::sqrt(1.0f - a_prev) - step.latent_scale * std::sqrt(1.0f - a_t);
+  step.x0_latent_scale = 1.0f / std::sqrt(a_t);
+  step.x0_noise_scale = -std::sqrt(1.0f - a_t) / std::sqrt(a_t);
+  return step;
+}
+
+class DdimScheduler : public Scheduler {
+ public:
+  explicit DdimScheduler(int num_steps)
+      : Scheduler(leading_timesteps(num_steps)) {}
+
+  SchedulerStep step(int index) const override {
+    return ddim_step(alpha(index), alpha_prev(index));
+  }
+};
+
+// Multistep DPM-Solver++(2M) in data prediction, see
+// https://arxiv.org/abs/2211.01095. The first and the last step are first
+// order, which equals DDIM.
+class DpmSolverScheduler : public Scheduler {
+ public:
+  explicit DpmSolverScheduler(int num_steps)
+      : Scheduler(leading_timesteps(num_steps)) {}
+
+  bool uses_history() const override { return true; }
+
+  SchedulerStep step(int index) const override {
+    float a_t = alpha(index);
+    float a_prev = alpha_prev(index);
+    SchedulerStep step = ddim_step(a_t, a_prev);
+    if (index == num_steps() - 1 || a_prev >= 1.0f) return step;
+
+    // lambda = log(alpha / sigma) of the previous, current and next step.
+    float lambda_last = lambda(alpha(index + 1));
+    float lambda_t = lambda(a_t);
+    float lambda_next = lambda(a_prev);
+    float h = lambda_next - lambda_t;
+    float r = (lambda_t - lambda_last) / h;
+
+    // x_prev = sigma_prev / sigma_t * x
+    //          + k * ((1 + 1 / 2r) * x0 - 1 / 2r * x0_last)
+    float sigma_t = std::sqrt(1.0f - a_t);
+    float k = std::sqrt(a_prev) * (1.0f - std::exp(-h));
+    float x0_weight = k * (1.0f + 0.5f / r);
+    step.latent_scale =
+        std::sqrt(1.0f - a_prev) / sigma_t + x0_weight * step.x0_latent_scale;
+    step.noise_scale = x0_weight * step.x0_noise_scale;
+    step.history_scale = -k * 0.5f / r;
+    return step;
+  }
+
+ private:
+  static float lambda(float a) { return 0.5f * std::log(a / (1.0f - a)); }
+};
+
+// Euler ancestral sampling as in k-diffusion. It runs on x = latent / sqrt(a)
+// with sigma = sqrt((1 - a) / a), which the coefficients fold back into the
+// latent the UNet takes.
+class EulerAncestralScheduler : public Scheduler {
+ public:
+  explicit EulerAncestralScheduler(int num_steps)
+      : Scheduler(leading_timesteps(num_steps)) {}
+
+  bool uses_noise() const override { return true; }
+
+  SchedulerStep step(int index) const override {
+    float a_t = alpha(index);
+    float a_prev = alpha_prev(index);
+    float sigma = std::sqrt((1.0f - a_t) / a_t);
+    float sigma_next = std::sqrt((1.0f - a_prev) / a_prev);
+    float sigma_down = sigma_next * sigma_next / sigma;
+    float sigma_up = std::sqrt(
+        std::max(0.0f, sigma_next * sigma_next - sigma_down * sigma_down));
+
+    SchedulerStep step;
+    step.latent_scale = std::sqrt(a_prev) / std::sqrt(a_t);
+    step.noise_scale = std::sqrt(a_prev) * (sigma_down - sigma);
+    step.random_scale = std::sqrt(a_prev) * sigma_up;
+    return step;
+  }
+};
+
+// Latent consistency model sampling, see https://arxiv.org/abs/2310.04378.
+// It needs a UNet distilled for LCM and usually runs without guidance.
+class LcmScheduler : public Scheduler {
+ public:
+  static constexpr int kOriginalSteps = 50;
+
+  explicit LcmScheduler(int num_steps) : Scheduler(lcm_timesteps(num_steps)) {}
+
+  bool uses_noise() const override { return true; }
+  bool accepts_timesteps() const override { return false; }
+
+  SchedulerStep step(int index) const override {
+    float a_t = alpha(index);
+    float a_prev = alpha_prev(index);
+    // Boundary conditions with sigma_data = 0.5 and a timestep scaling of 10.
+    float scaled_t = 10.0f * timesteps()[index];
+    float c_skip = 0.25f / (scaled_t * scaled_t + 0.25f);
+    float c_out = scaled_t / std::sqrt(scaled_t * scaled_t + 0.25f);
+
+    // denoised = c_out * x0 + c_skip * x
+    // x_prev = sqrt(a_prev) * denoised + sqrt(1 - a_prev) * n
+    SchedulerStep step;
+    step.latent_scale =
+        std::sqrt(a_prev) * (c_out / std::sqrt(a_t) + c_skip);
+    step.noise_scale =
+        -std::sqrt(a_prev) * c_out * std::sqrt(1.0f - a_t) / std::sqrt(a_t);
+    step.random_scale = std::sqrt(1.0f - a_prev);
+    return step;
+  }
+
+ private:
+  // Every skip-th timestep of the original schedule, from the noisiest.
+  static std::vector<int> lcm_timesteps(int num_steps) {
+    int stride = kTrainTimesteps / kOriginalSteps;
+    int skip = kOriginalSteps / num_steps;
+    std::vector<int> timesteps;
+    for (int i = 0; i < num_steps; ++i) {
+      timesteps.insert(timesteps.begin(),
+                       (kOriginalSteps - i * skip) * stride - 1);
+    }
+    return timesteps;
+  }
+};
+
+}  // namespace
+
+Scheduler::Scheduler(std::vector<int> timesteps) {
+  set_timesteps(timesteps);
+}
+
+void Scheduler::set_timesteps(const std::vector<int>& timesteps) {
+  timesteps_ = timesteps;
+  std::tie(alphas_, alphas_prev_) = get_initial_alphas(timesteps_);
+}
+
+std::unique_ptr<Scheduler> Scheduler::Create(const std::string& name,
+                                             int num_steps) {
+  // The alpha table has kTrainTimesteps entries, so the leading timesteps of
+  // kTrainTimesteps steps would read past it.
+  if (num_steps <= 0 || num_steps >= kTrainTimesteps) {
+    LOG(ERROR) << "Unsupported number of steps: " << num_steps;
+    return nullptr;
+  }
+  if (name == "ddim") {
+    return std::make_unique<DdimScheduler>(num_steps);
+  } else if (name == "dpm++2m") {
+    return std::make_unique<DpmSolverScheduler>(num_steps);
+  } else if (name == "euler_a") {
+    return std::make_unique<EulerAncestralScheduler>(num_steps);
+  } else if (name == "lcm") {
+    if (num_steps > LcmScheduler::kOriginalSteps) {
+      LOG(ERROR) << "LCM supports at most " << LcmScheduler::kOriginalSteps
+                 << " steps";
+      return nullptr;
+    }
+    return std::make_unique<LcmScheduler>(num_steps);
+  }
+  LOG(ERROR) << "Unknown scheduler: " << name;
+  return nullptr;
+}
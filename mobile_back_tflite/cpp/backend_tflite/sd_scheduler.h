@@ -0,0 +1,66 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef TFLITE_SD_SCHEDULER_H_
+#define TFLITE_SD_SCHEDULER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sd_utils.h"
+
+// A sampler for the Stable Diffusion latent. All schedulers work on the
+// latent as the UNet takes it, so it can stay in the UNet input between
+// steps, and on the epsilon prediction of the UNet.
+class Scheduler {
+ public:
+  virtual ~Scheduler() = default;
+
+  // Creates a scheduler by name: "ddim", "dpm++2m", "euler_a" or "lcm".
+  // Returns nullptr for an unknown name or an unsupported step count.
+  static std::unique_ptr<Scheduler> Create(const std::string& name,
+                                           int num_steps);
+
+  // Replaces the timesteps, e.g. with the ones of a precomputed embedding
+  // table. The timesteps are in ascending order.
+  void set_timesteps(const std::vector<int>& timesteps);
+
+  // Timesteps in ascending order. Sampling runs from the last to the first.
+  const std::vector<int>& timesteps() const { return timesteps_; }
+  int num_steps() const { return timesteps_.size(); }
+
+  // Whether the steps read the x0 prediction of the previous step.
+  virtual bool uses_history() const { return false; }
+  // Whether the steps add fresh Gaussian noise.
+  virtual bool uses_noise() const { return false; }
+  // Whether set_timesteps() keeps the results of the sampler meaningful.
+  virtual bool accepts_timesteps() const { return true; }
+
+  // Coefficients for the step at timesteps()[index].
+  virtual SchedulerStep step(int index) const = 0;
+
+ protected:
+  explicit Scheduler(std::vector<int> timesteps);
+
+  // The cumulative alpha at timesteps()[index] and at the timestep sampled
+  // after it, which is 1 after the last step.
+  float alpha(int index) const { return alphas_[index]; }
+  float alpha_prev(int index) const { return alphas_prev_[index]; }
+
+ private:
+  std::vector<int> timesteps_;
+  std::vector<float> alphas_;
+  std::vector<float> alphas_prev_;
+};
+
+#endif  // TFLITE_SD_SCHEDULER_H_
@@ -0,0 +1,57 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "sd_scheduler.h"
+
+#include <cmath>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+constexpr int kTrainTimesteps = 1000;
+
+TEST(Scheduler, RejectsUnsupportedStepCounts) {
+  for (const char* name : {"ddim", "dpm++2m", "euler_a", "lcm"}) {
+    EXPECT_EQ(Scheduler::Create(name, 0), nullptr) << name;
+    EXPECT_EQ(Scheduler::Create(name, kTrainTimesteps), nullptr) << name;
+  }
+  EXPECT_EQ(Scheduler::Create("lcm", 51), nullptr);
+  EXPECT_EQ(Scheduler::Create("unknown", 20), nullptr);
+}
+
+TEST(Scheduler, KeepsTimestepsInsideAlphaTable) {
+  for (const char* name : {"ddim", "dpm++2m", "euler_a"}) {
+    auto scheduler = Scheduler::Create(name, kTrainTimesteps - 1);
+    ASSERT_NE(scheduler, nullptr) << name;
+    EXPECT_EQ(scheduler->num_steps(), kTrainTimesteps - 1);
+    EXPECT_EQ(scheduler->timesteps().front(), 1);
+    EXPECT_LT(scheduler->timesteps().back(), kTrainTimesteps) << name;
+    for (int i = 0; i < scheduler->num_steps(); ++i) {
+      ASSERT_TRUE(std::isfinite(scheduler->step(i).latent_scale))
+          << name << " step " << i;
+    }
+  }
+  auto lcm = Scheduler::Create("lcm", 50);
+  ASSERT_NE(lcm, nullptr);
+  EXPECT_LT(lcm->timesteps().back(), kTrainTimesteps);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,11 @@
 #include "sd_utils.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 std::vector<int> get_timesteps(int start, int stop, int delta) {
   std::vector<int> timesteps;
   for (int i = start; i < stop; i += delta) {
@@ -263,3 +269,75 @@ int main(int argc, char *argv[]) {
   std::cout << "\n";
 }
 #endif
+
+void guided_scheduler_step(const float* unconditional_noise,
+                           const float* noise, size_t size,
+                           float guidance_scale, const SchedulerStep& step,
+                           const float* random, float* history, float* latent,
+                           float* latent_copy) {
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256 guidance = _mm256_set1_ps(guidance_scale);
+  const __m256 latent_scale = _mm256_set1_ps(step.latent_scale);
+  const __m256 noise_scale = _mm256_set1_ps(step.noise_scale);
+  const __m256 history_scale = _mm256_set1_ps(step.history_scale);
+  const __m256 random_scale = _mm256_set1_ps(step.random_scale);
+  const __m256 x0_latent_scale = _mm256_set1_ps(step.x0_latent_scale);
+  const __m256 x0_noise_scale = _mm256_set1_ps(step.x0_noise_scale);
+  for (; i + 8 <= size; i += 8) {
+    __m256 u = _mm256_loadu_ps(unconditional_noise + i);
+    __m256 c = _mm256_loadu_ps(noise + i);
+    __m256 e = _mm256_add_ps(u, _mm256_mul_ps(guidance, _mm256_sub_ps(c, u)));
+    __m256 x = _mm256_loadu_ps(latent + i);
+    __m256 next = _mm256_add_ps(_mm256_mul_ps(latent_scale, x),
+                                _mm256_mul_ps(noise_scale, e));
+    if (history) {
+      __m256 x0 = _mm256_add_ps(_mm256_mul_ps(x0_latent_scale, x),
+                                _mm256_mul_ps(x0_noise_scale, e));
+      next = _mm256_add_ps(
+          next, _mm256_mul_ps(history_scale, _mm256_loadu_ps(history + i)));
+      _mm256_storeu_ps(history + i, x0);
+    }
+    if (random) {
+      next = _mm256_add_ps(
+          next, _mm256_mul_ps(random_scale, _mm256_loadu_ps(random + i)));
+    }
+    _mm256_storeu_ps(latent + i, next);
+    if (latent_copy) _mm256_storeu_ps(latent_copy + i, next);
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  for (; i + 4 <= size; i += 4) {
+    float32x4_t u = vld1q_f32(unconditional_noise + i);
+    float32x4_t c = vld1q_f32(noise + i);
+    float32x4_t e = vfmaq_n_f32(u, vsubq_f32(c, u), guidance_scale);
+    float32x4_t x = vld1q_f32(latent + i);
+    float32x4_t next =
+        vfmaq_n_f32(vmulq_n_f32(x, step.latent_scale), e, step.noise_scale);
+    if (history) {
+      float32x4_t x0 = vfmaq_n_f32(vmulq_n_f32(x, step.x0_latent_scale), e,
+                                   step.x0_noise_scale);
+      next = vfmaq_n_f32(next, vld1q_f32(history + i), step.history_scale);
+      vst1q_f32(history + i, x0);
+    }
+    if (random) {
+      next = vfmaq_n_f32(next, vld1q_f32(random + i), step.random_scale);
+    }
+    vst1q_f32(latent + i, next);
+    if (latent_copy) vst1q_f32(latent_copy + i, next);
+  }
+#endif
+  // Leftover loop.
+  for (; i < size; ++i) {
+    float u = unconditional_noise[i];
+    float e = u + guidance_scale * (noise[i] - u);
+    float x = latent[i];
+    float next = step.latent_scale * x + step.noise_scale * e;
+    if (history) {
+      next += step.history_scale * history[i];
+      history[i] = step.x0_latent_scale * x + step.x0_noise_scale * e;
+    }
+    if (random) next += step.random_scale * random[i];
+    latent[i] = next;
+    if (latent_copy) latent_copy[i] = next;
+  }
+}
@@ -1,4 +1,5 @@
 #include <cmath>
+#include <cstddef>
 #include <iostream>
 #include <map>
 #include <tuple>
@@ -14,4 +15,30 @@ std::vector<float> get_timestep_embedding(int timestep, int batch_size = 1,
                                           int dim = 320,
                                           int max_period = 10000);
 
+// Coefficients of one sampler step on the latent x, the guided noise
+// prediction e, the x0 prediction h of the previous step and fresh Gaussian
+// noise n:
+//   x0 = x0_latent_scale * x + x0_noise_scale * e
+//   x = latent_scale * x + noise_scale * e + history_scale * h +
+//       random_scale * n
+struct SchedulerStep {
+  float latent_scale = 0.0f;
+  float noise_scale = 0.0f;
+  float history_scale = 0.0f;
+  float random_scale = 0.0f;
+  float x0_latent_scale = 0.0f;
+  float x0_noise_scale = 0.0f;
+};
+
+// Applies classifier-free guidance to the noise predictions and takes one
+// sampler step on the latent in place. history, if not null, holds the x0
+// prediction of the previous step and is overwritten with the current one.
+// random may be null if random_scale is 0. latent_copy, if not null,
+// receives the same result as latent.
+void guided_scheduler_step(const float* unconditional_noise,
+                           const float* noise, size_t size,
+                           float guidance_scale, const SchedulerStep& step,
+                           const float* random, float* history, float* latent,
+                           float* latent_copy);
+
 #endif
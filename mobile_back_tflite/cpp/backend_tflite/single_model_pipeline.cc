@@ -14,8 +14,10 @@ limitations under the License.
 ==============================================================================*/
 #include "single_model_pipeline.h"
 
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <new>
 
 #if defined(MTK_TFLITE_NEURON_BACKEND) && defined(__ANDROID__)
 #include <dlfcn.h>
@@ -25,6 +27,7 @@ limitations under the License.
 
 #include "flutter/cpp/c/type.h"
 #include "tensorflow/lite/c/c_api.h"
+#include "tensorflow/lite/c/c_api_experimental.h"
 #include "tensorflow/lite/c/common.h"
 #if __ANDROID__
 #include <sys/system_properties.h>
@@ -55,6 +58,9 @@ limitations under the License.
 static struct AdapterBackendData *neuron_backend = nullptr;
 #endif
 
+// Alignment required by TFLite for custom tensor allocations.
+static constexpr size_t kTensorAlignment = 64;
+
 struct TFLiteBackendData {
   const char *name = "TFLite";
   const char *vendor = "Google";
@@ -66,6 +72,9 @@ struct TFLiteBackendData {
   uint32_t real_batch_size = 1;
   std::unique_ptr<Threadpool> executer;
   int32_t original_tensor_size = 0;
+  // Backend owned storage for inputs that were bound to sample buffers and
+  // are later set by copy, indexed by shard and input.
+  std::vector<std::vector<void *>> input_storage;
 #ifdef MTK_TFLITE_NEURON_BACKEND
   neuron_backend_ptr_t neuronBackendData{nullptr};
 #endif
@@ -179,6 +188,13 @@ void SingleModelPipeline::backend_delete(mlperf_backend_ptr_t backend_ptr) {
     TfLiteInterpreterOptionsDelete(backend_data->options[i]);
     TfLiteInterpreterDelete(backend_data->interpreter[i]);
   }
+  for (auto &shard_storage : backend_data->input_storage) {
+    for (void *storage : shard_storage) {
+      if (storage) {
+        ::operator delete(storage, std::align_val_t(kTensorAlignment));
+      }
+    }
+  }
   delete backend_data;
   backendExists = false;
 }
@@ -257,8 +273,9 @@ mlperf_backend_ptr_t SingleModelPipeline::backend_create(
         configs->batch_size / backend_data->shards_num;
   }
 
-  backend_data->executer =
-      std::unique_ptr<Threadpool>(new Threadpool(backend_data->shards_num));
+  // The calling thread runs the first shard, so one worker less is needed.
+  backend_data->executer = std::unique_ptr<Threadpool>(
+      new Threadpool(backend_data->shards_num - 1));
 
   // Create interpreter options function.
   auto create_option = [&](TfLiteInterpreterOptions *&option_ptr) -> void {
@@ -443,28 +460,19 @@ mlperf_status_t SingleModelPipeline::backend_issue_query(
   }
 #endif
 
-  auto task = [&backend_data](int index) -> TfLiteStatus {
-    return TfLiteInterpreterInvoke(backend_data->interpreter[index]);
-  };
-
-  std::vector<std::future<TfLiteStatus>> f;
-  f.resize(backend_data->shards_num);
-  // dispatch workers for shards
-  for (int k = 1; k < backend_data->shards_num; k++) {
-    f[k] = backend_data->executer->submit(task, k);
-  }
-  // main thread for the first shard
-  if (task(0) != kTfLiteOk) {
+  // Run all shards, the first one on the calling thread.
+  std::atomic<bool> failed{false};
+  backend_data->executer->parallel_for(
+      backend_data->shards_num, [backend_data, &failed](size_t index) {
+        if (TfLiteInterpreterInvoke(backend_data->interpreter[index]) !=
+            kTfLiteOk) {
+          failed = true;
+        }
+      });
+  if (failed) {
     LOG(ERROR) << "Failed to run the inference";
     return MLPERF_FAILURE;
   }
-  // sync and get result of workers
-  for (int k = 1; k < backend_data->shards_num; k++) {
-    if (f[k].get() != kTfLiteOk) {
-      LOG(ERROR) << "Failed to run the inference";
-      return MLPERF_FAILURE;
-    }
-  }
   return MLPERF_SUCCESS;
 }
 
@@ -549,8 +557,30 @@ mlperf_status_t SingleModelPipeline::backend_set_input(
 #endif
 
   const int shard_index = batch_index / backend_data->real_batch_size;
-  TfLiteTensor *tensor = TfLiteInterpreterGetInputTensor(
-      backend_data->interpreter[shard_index], i);
+  TfLiteInterpreter *interpreter = backend_data->interpreter[shard_index];
+  TfLiteTensor *tensor = TfLiteInterpreterGetInputTensor(interpreter, i);
+  if (tensor->allocation_type == kTfLiteCustom) {
+    // The tensor still points to a sample buffer from backend_bind_input.
+    // Move it to backend owned storage so the sample is not overwritten.
+    if (backend_data->input_storage.empty()) {
+      backend_data->input_storage.resize(backend_data->shards_num);
+    }
+    auto &shard_storage = backend_data->input_storage[shard_index];
+    if (shard_storage.size() <= static_cast<size_t>(i)) {
+      shard_storage.resize(i + 1, nullptr);
+    }
+    if (!shard_storage[i]) {
+      shard_storage[i] =
+          ::operator new(tensor->bytes, std::align_val_t(kTensorAlignment));
+    }
+    TfLiteCustomAllocation allocation = {shard_storage[i], tensor->bytes};
+    if (TfLiteInterpreterSetCustomAllocationForTensor(
+            interpreter, TfLiteInterpreterGetInputTensorIndex(interpreter, i),
+            &allocation, kTfLiteCustomAllocationFlagsNone) != kTfLiteOk) {
+      LOG(ERROR) << "Failed to restore storage of input " << i;
+      return MLPERF_FAILURE;
+    }
+  }
   const int data_offset = backend_data->original_tensor_size *
                           (batch_index % backend_data->real_batch_size);
   memcpy(tensor->data.raw + data_offset, data,
@@ -659,17 +689,50 @@ void SingleModelPipeline::backend_convert_outputs(
     mlperf_backend_ptr_t backend_ptr, int bytes, int width, int height,
     uint8_t *data) {}
 
+mlperf_status_t SingleModelPipeline::backend_bind_input(
+    mlperf_backend_ptr_t backend_ptr, int32_t batch_index, int32_t i,
+    void *data) {
+  TFLiteBackendData *backend_data = (TFLiteBackendData *)backend_ptr;
+#ifdef MTK_TFLITE_NEURON_BACKEND
+  if (neuron_backend != nullptr) return MLPERF_FAILURE;
+#endif
+  // Samples can only be used directly when every shard holds one of them.
+  if (backend_data->real_batch_size != 1 ||
+      batch_index >= backend_data->shards_num) {
+    return MLPERF_FAILURE;
+  }
+  if (reinterpret_cast<uintptr_t>(data) % kTensorAlignment != 0) {
+    return MLPERF_FAILURE;
+  }
+
+  TfLiteInterpreter *interpreter = backend_data->interpreter[batch_index];
+  TfLiteTensor *tensor = TfLiteInterpreterGetInputTensor(interpreter, i);
+  // Inputs backed by delegate buffers cannot be redirected.
+  if (tensor->buffer_handle != kTfLiteNullBufferHandle) return MLPERF_FAILURE;
+
+  // Reassigning a custom allocation does not need AllocateTensors(), so this
+  // only updates the data pointer of the tensor.
+  TfLiteCustomAllocation allocation = {data, tensor->bytes};
+  if (TfLiteInterpreterSetCustomAllocationForTensor(
+          interpreter, TfLiteInterpreterGetInputTensorIndex(interpreter, i),
+          &allocation, kTfLiteCustomAllocationFlagsNone) != kTfLiteOk) {
+    return MLPERF_FAILURE;
+  }
+  return MLPERF_SUCCESS;
+}
+
+// Buffers are aligned so that they can be bound as input tensors.
 void *SingleModelPipeline::backend_get_buffer(size_t n) {
 #ifdef MTK_TFLITE_NEURON_BACKEND
   if (neuron_backend != nullptr) {
-    return ::operator new(n * 2);
+    return ::operator new(n * 2, std::align_val_t(kTensorAlignment));
   }
 #endif
-  return ::operator new(n);
+  return ::operator new(n, std::align_val_t(kTensorAlignment));
 }
 
 void SingleModelPipeline::backend_release_buffer(void *p) {
-  ::operator delete(p);
+  ::operator delete(p, std::align_val_t(kTensorAlignment));
 }
 
 #ifdef __cplusplus
@@ -68,6 +68,10 @@ class SingleModelPipeline : public Pipeline {
   void backend_convert_outputs(mlperf_backend_ptr_t backend_ptr, int bytes,
                                int width, int height, uint8_t *data) override;
 
+  mlperf_status_t backend_bind_input(mlperf_backend_ptr_t backend_ptr,
+                                     int32_t batch_index, int32_t i,
+                                     void *data) override;
+
   void *backend_get_buffer(size_t n) override;
 
   void backend_release_buffer(void *p) override;
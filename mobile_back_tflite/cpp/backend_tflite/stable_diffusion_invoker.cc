@@ -1,13 +1,14 @@
 #include "stable_diffusion_invoker.h"
 
+#include <algorithm>
 #include <iostream>
 #include <random>
-#include <valarray>
 
-#include "embedding_utils.h"
+#include "sd_scheduler.h"
 #include "sd_utils.h"
 #include "stable_diffusion_pipeline.h"
 #include "tensorflow/lite/c/c_api.h"
+#include "tensorflow/lite/c/c_api_experimental.h"
 #include "tensorflow/lite/c/common.h"
 
 std::vector<float> get_normal(unsigned numbers, unsigned seed = 5,
@@ -24,57 +25,103 @@ std::vector<float> get_normal(unsigned numbers, unsigned seed = 5,
 StableDiffusionInvoker::StableDiffusionInvoker(SDBackendData* backend_data)
     : backend_data_(backend_data) {}
 
-std::vector<float> StableDiffusionInvoker::invoke() {
+bool StableDiffusionInvoker::invoke() {
   LOG(INFO) << "Prompt encoding started";
-  auto encoded_text = encode_prompt(backend_data_->input_prompt_tokens);
-  auto unconditional_encoded_text =
-      encode_prompt(backend_data_->unconditional_tokens);
+  if (!encode_prompt_cached(backend_data_->input_prompt_tokens)) return false;
   LOG(INFO) << "Diffusion process started";
-  auto latent =
-      diffusion_process(encoded_text, unconditional_encoded_text,
-                        backend_data_->num_steps, backend_data_->seed);
+  diffusion_process(backend_data_->seed);
   LOG(INFO) << "Image decoding started";
-  return decode_image(latent);
+  decode_image();
+  return true;
 }
 
-std::vector<float> StableDiffusionInvoker::encode_prompt(
-    const std::vector<int>& data) {
-  return run_inference(backend_data_->text_encoder_interpreter, data);
+bool StableDiffusionInvoker::encode_prompt(const std::vector<int>& prompt,
+                                           float* context) {
+  TfLiteInterpreter* interpreter = backend_data_->text_encoder_interpreter;
+  if (!StableDiffusionPipeline::bind_tensor(
+          interpreter, TfLiteInterpreterGetOutputTensorIndex(interpreter, 0),
+          context, backend_data_->context_bytes)) {
+    LOG(ERROR) << "Failed to bind the text encoder output";
+    return false;
+  }
+  run_inference(interpreter, prompt);
+  return true;
+}
+
+bool StableDiffusionInvoker::encode_prompt_cached(
+    const std::vector<int>& prompt) {
+  float* context = backend_data_->context;
+  if (backend_data_->max_cached_encodings == 0) {
+    return encode_prompt(prompt, context);
+  }
+  size_t context_size = backend_data_->context_bytes / sizeof(float);
+  auto& cache = backend_data_->encoding_cache;
+  auto it =
+      std::find_if(cache.begin(), cache.end(),
+                   [&](const auto& entry) { return entry.first == prompt; });
+  if (it != cache.end()) {
+    cache.splice(cache.begin(), cache, it);
+    std::copy(it->second.begin(), it->second.end(), context);
+    return true;
+  }
+  if (!encode_prompt(prompt, context)) return false;
+  if (cache.size() >= backend_data_->max_cached_encodings) cache.pop_back();
+  cache.emplace_front(prompt,
+                      std::vector<float>(context, context + context_size));
+  return true;
 }
 
-std::vector<float> StableDiffusionInvoker::diffusion_step(
-    const std::vector<float>& latent, const std::vector<float>& t_emb,
-    const std::vector<float>& context) {
-  auto latent_input_details =
-      TfLiteInterpreterGetInputTensor(backend_data_->sd_interpreter, 0);
-  auto context_input_details =
-      TfLiteInterpreterGetInputTensor(backend_data_->sd_interpreter, 1);
-  auto time_stamp_embedding_input_details =
-      TfLiteInterpreterGetInputTensor(backend_data_->sd_interpreter, 2);
-
-  std::copy(context.begin(), context.end(),
-            reinterpret_cast<float*>(TfLiteTensorData(context_input_details)));
-  std::copy(t_emb.begin(), t_emb.end(),
-            reinterpret_cast<float*>(
-                TfLiteTensorData(time_stamp_embedding_input_details)));
-  std::copy(latent.begin(), latent.end(),
-            reinterpret_cast<float*>(TfLiteTensorData(latent_input_details)));
+namespace {
 
-  // Invoke the model
-  if (TfLiteInterpreterInvoke(backend_data_->sd_interpreter) != kTfLiteOk) {
-    std::cerr << "Failed to invoke the first diffusion model!" << std::endl;
+float* input_data(TfLiteInterpreter* interpreter, int index) {
+  return reinterpret_cast<float*>(
+      TfLiteTensorData(TfLiteInterpreterGetInputTensor(interpreter, index)));
+}
+
+const float* output_data(TfLiteInterpreter* interpreter, int index) {
+  return reinterpret_cast<const float*>(
+      TfLiteTensorData(TfLiteInterpreterGetOutputTensor(interpreter, index)));
+}
+
+void invoke_unet(TfLiteInterpreter* interpreter) {
+  if (TfLiteInterpreterInvoke(interpreter) != kTfLiteOk) {
+    std::cerr << "Failed to invoke the diffusion model!" << std::endl;
     exit(-1);
   }
+}
+
+}  // namespace
 
-  float* output = reinterpret_cast<float*>(TfLiteTensorData(
-      TfLiteInterpreterGetOutputTensor(backend_data_->sd_interpreter, 0)));
-  int output_size = TfLiteTensorByteSize(TfLiteInterpreterGetOutputTensor(
-                        backend_data_->sd_interpreter, 0)) /
-                    sizeof(float);
-  return std::vector<float>(output, output + output_size);
+void StableDiffusionInvoker::diffusion_step(TfLiteInterpreter* interpreter,
+                                            const std::vector<float>& t_emb,
+                                            float* context) {
+  if (context &&
+      !StableDiffusionPipeline::bind_tensor(
+          interpreter, TfLiteInterpreterGetInputTensorIndex(interpreter, 1),
+          context, backend_data_->context_bytes)) {
+    std::cerr << "Failed to bind the diffusion model context!" << std::endl;
+    exit(-1);
+  }
+  std::copy(t_emb.begin(), t_emb.end(), input_data(interpreter, 2));
+  invoke_unet(interpreter);
+}
+
+void StableDiffusionInvoker::diffusion_step_batched(
+    const std::vector<float>& t_emb) {
+  TfLiteInterpreter* interpreter = backend_data_->sd_interpreter;
+  float* t_emb_input = input_data(interpreter, 2);
+  size_t t_emb_rows = TfLiteTensorByteSize(TfLiteInterpreterGetInputTensor(
+                          interpreter, 2)) /
+                      sizeof(float) / t_emb.size();
+
+  // The context rows are already in place. Both rows share the timestep
+  // embedding, which may also be exported with a single row.
+  for (size_t row = 0; row < t_emb_rows; ++row) {
+    std::copy(t_emb.begin(), t_emb.end(), t_emb_input + row * t_emb.size());
+  }
+  invoke_unet(interpreter);
 }
 
-// Helper function to get tensor index by name
 int StableDiffusionInvoker::get_tensor_index_by_name(
     TfLiteInterpreter* interpreter, const std::string& name, bool is_input) {
   int tensor_count = is_input
@@ -95,75 +142,126 @@ int StableDiffusionInvoker::get_tensor_index_by_name(
   return -1;
 }
 
-std::vector<float> StableDiffusionInvoker::diffusion_process(
-    const std::vector<float>& encoded_text,
-    const std::vector<float>& unconditional_encoded_text, int num_steps,
-    int seed) {
-  float unconditional_guidance_scale = 7.5f;
-
-  auto noise = get_normal(64 * 64 * 4, seed);
-  auto latent = noise;
-
-  // Get pre-calculated timesteps and embeddings
-  auto& embedding_manager = EmbeddingManager::getInstance();
-  auto timesteps = embedding_manager.get_timesteps(num_steps);
-
-  if (timesteps.empty()) {
-    LOG(ERROR) << "Failed to get timesteps for " << num_steps << " steps";
-    return std::vector<float>();
+void StableDiffusionInvoker::diffusion_process(int seed) {
+  const Scheduler& scheduler = *backend_data_->scheduler;
+  const float guidance_scale = backend_data_->guidance_scale;
+  constexpr size_t latent_size = 64 * 64 * 4;
+
+  // The latent lives in the UNet latent input between steps. The guidance and
+  // scheduler update reads the noise predictions from the output tensors and
+  // writes the next latent back in place. The unconditional branch needs its
+  // own copy when it runs in the second batch row or on a second interpreter.
+  TfLiteInterpreter* interpreter = backend_data_->sd_interpreter;
+  TfLiteInterpreter* unconditional_interpreter =
+      backend_data_->sd_unconditional_interpreter;
+  float* latent = input_data(interpreter, 0);
+  float* latent_copy = nullptr;
+  if (backend_data_->batched_cfg) {
+    latent_copy = latent + latent_size;
+  } else if (unconditional_interpreter) {
+    latent_copy = input_data(unconditional_interpreter, 0);
   }
 
-  auto alphas_tuple = get_initial_alphas(timesteps);
-
-  auto alphas = std::get<0>(alphas_tuple);
-  auto alphas_prev = std::get<1>(alphas_tuple);
-
-  for (int i = timesteps.size() - 1; i >= 0; --i) {
-    LOG(INFO) << "Step " << timesteps.size() - 1 - i;
-
-    auto latent_prev = latent;
-
-    auto t_emb = embedding_manager.get_timestep_embedding(i, num_steps);
-
-    if (t_emb.empty()) {
-      LOG(ERROR) << "Failed to get timestamp embedding for step " << i;
-      return std::vector<float>();
+  auto noise = get_normal(latent_size, seed);
+  std::copy(noise.begin(), noise.end(), latent);
+  if (latent_copy) std::copy(noise.begin(), noise.end(), latent_copy);
+
+  // Only a single interpreter running both branches switches its context
+  // input. The other interpreters keep theirs resident.
+  float* switched_context =
+      backend_data_->context_storage.empty() ? nullptr : backend_data_->context;
+
+  // Without guidance only the conditional branch matters. A batch 2 UNet
+  // still runs both rows.
+  const bool unconditional_branch =
+      backend_data_->batched_cfg || guidance_scale != 1.0f;
+
+  // Holds the unconditional prediction when both branches share one
+  // interpreter, as the conditional invocation overwrites the output tensor.
+  std::vector<float> unconditional_buffer;
+  if (unconditional_branch && !backend_data_->batched_cfg &&
+      !unconditional_interpreter) {
+    unconditional_buffer.resize(latent_size);
+  }
+  // The x0 prediction of the previous step for multistep schedulers.
+  std::vector<float> history(scheduler.uses_history() ? latent_size : 0);
+  // Fresh noise for ancestral and consistency sampling, drawn from its own
+  // generator so the initial latent does not depend on the scheduler.
+  std::vector<float> random(scheduler.uses_noise() ? latent_size : 0);
+  std::default_random_engine generator(seed + 1);
+  std::normal_distribution<float> distribution;
+
+  for (int i = scheduler.num_steps() - 1; i >= 0; --i) {
+    LOG(INFO) << "Step " << scheduler.num_steps() - 1 - i;
+
+    const auto& t_emb = backend_data_->timestep_embeddings[i];
+
+    const float* unconditional_prediction;
+    const float* prediction;
+    if (backend_data_->batched_cfg) {
+      diffusion_step_batched(t_emb);
+      unconditional_prediction = output_data(interpreter, 0);
+      prediction = unconditional_prediction + latent_size;
+    } else if (!unconditional_branch) {
+      diffusion_step(interpreter, t_emb, switched_context);
+      prediction = output_data(interpreter, 0);
+      unconditional_prediction = prediction;
+    } else if (unconditional_interpreter) {
+      backend_data_->executer->parallel_for(2, [&](size_t branch) {
+        if (branch == 0) {
+          diffusion_step(unconditional_interpreter, t_emb);
+        } else {
+          diffusion_step(interpreter, t_emb);
+        }
+      });
+      unconditional_prediction = output_data(unconditional_interpreter, 0);
+      prediction = output_data(interpreter, 0);
+    } else {
+      // The single interpreter switches its context input between the two
+      // resident contexts.
+      diffusion_step(interpreter, t_emb, backend_data_->unconditional_context);
+      std::copy(output_data(interpreter, 0),
+                output_data(interpreter, 0) + latent_size,
+                unconditional_buffer.begin());
+      diffusion_step(interpreter, t_emb, backend_data_->context);
+      unconditional_prediction = unconditional_buffer.data();
+      prediction = output_data(interpreter, 0);
     }
 
-    if (t_emb.empty()) {
-      LOG(ERROR) << "Failed to get timestamp embedding for step " << i;
-      return std::vector<float>();
+    const SchedulerStep step = scheduler.step(i);
+    if (!random.empty()) {
+      for (float& value : random) value = distribution(generator);
     }
 
-    auto unconditional_latent =
-        diffusion_step(latent, t_emb, unconditional_encoded_text);
-    latent = diffusion_step(latent, t_emb, encoded_text);
-
-    std::valarray<float> l(latent.data(), latent.size());
-    std::valarray<float> l_prev(latent_prev.data(), latent_prev.size());
-    std::valarray<float> u(unconditional_latent.data(),
-                           unconditional_latent.size());
-
-    l = u + unconditional_guidance_scale * (l - u);
-
-    auto a_t = alphas[i];
-    auto a_prev = alphas_prev[i];
-
-    auto prev_x0 = (l_prev - sqrtf(1.0f - a_t) * l) / sqrtf(a_t);
-    l = (l * sqrtf(1.0f - a_prev) + sqrtf(a_prev) * prev_x0);
-    latent.assign(std::begin(l), std::end(l));
+    // One chunk per thread.
+    const size_t num_chunks = backend_data_->executer->size() + 1;
+    const size_t chunk_size = (latent_size + num_chunks - 1) / num_chunks;
+    backend_data_->executer->parallel_for(num_chunks, [&](size_t chunk) {
+      size_t begin = std::min(latent_size, chunk * chunk_size);
+      size_t end = std::min(latent_size, begin + chunk_size);
+      guided_scheduler_step(
+          unconditional_prediction + begin, prediction + begin, end - begin,
+          guidance_scale, step,
+          random.empty() ? nullptr : random.data() + begin,
+          history.empty() ? nullptr : history.data() + begin, latent + begin,
+          latent_copy ? latent_copy + begin : nullptr);
+    });
   }
 
   LOG(INFO) << "Diffusion process completed!";
-  return latent;
 }
 
-std::vector<float> StableDiffusionInvoker::decode_image(
-    const std::vector<float>& latent) {
-  return run_inference(backend_data_->decoder_interpreter, latent);
+void StableDiffusionInvoker::decode_image() {
+  // The decoder input is bound to the latent input of the UNet, see
+  // StableDiffusionPipeline::bind_tensors().
+  if (TfLiteInterpreterInvoke(backend_data_->decoder_interpreter) !=
+      kTfLiteOk) {
+    std::cerr << "Failed to invoke the decoder model!" << std::endl;
+    exit(-1);
+  }
 }
 
-std::vector<float> StableDiffusionInvoker::run_inference(
+void StableDiffusionInvoker::run_inference(
     TfLiteInterpreter* interpreter, const std::vector<int>& encoded) {
   // Determine the size of the encoded input
   int encoded_size = encoded.size();
@@ -189,37 +287,6 @@ std::vector<float> StableDiffusionInvoker::run_inference(
     std::cerr << "Failed to invoke tflite!" << std::endl;
     exit(-1);
   }
-
-  // Access the output tensor
-  const TfLiteTensor* output_tensor =
-      TfLiteInterpreterGetOutputTensor(interpreter, 0);
-  void* output_data = TfLiteTensorData(output_tensor);
-
-  // Calculate the number of elements in the output tensor
-  int output_size = TfLiteTensorByteSize(output_tensor) / sizeof(float);
-
-  // Cast output_data back to the correct type and return as a vector of floats
-  float* output = static_cast<float*>(output_data);
-  return std::vector<float>(output, output + output_size);
-}
-
-std::vector<float> StableDiffusionInvoker::run_inference(
-    TfLiteInterpreter* interpreter, const std::vector<float>& input) {
-  std::copy(input.begin(), input.end(),
-            reinterpret_cast<float*>(TfLiteTensorData(
-                TfLiteInterpreterGetInputTensor(interpreter, 0))));
-
-  if (TfLiteInterpreterInvoke(interpreter) != kTfLiteOk) {
-    std::cerr << "Failed to invoke the model!" << std::endl;
-    exit(-1);
-  }
-
-  float* output = reinterpret_cast<float*>(
-      TfLiteTensorData(TfLiteInterpreterGetOutputTensor(interpreter, 0)));
-  int output_size =
-      TfLiteTensorByteSize(TfLiteInterpreterGetOutputTensor(interpreter, 0)) /
-      sizeof(float);
-  return std::vector<float>(output, output + output_size);
 }
 
 std::vector<float> StableDiffusionInvoker::get_timestep_embedding(
@@ -14,28 +14,36 @@ class StableDiffusionInvoker {
   // Constructor that takes the backend data
   StableDiffusionInvoker(SDBackendData* backend_data);
 
-  // The main method to invoke the Stable Diffusion process
-  std::vector<float> invoke();
+  // The main method to invoke the Stable Diffusion process. The image is
+  // left in the output tensor of the decoder.
+  bool invoke();
+
+  // Runs the text encoder on the prompt tokens, writing the encoding to
+  // context.
+  bool encode_prompt(const std::vector<int>& prompt, float* context);
 
  private:
   // Helper methods to encapsulate different stages of the pipeline
-  std::vector<float> encode_prompt(const std::vector<int>& prompt);
-  std::vector<float> diffusion_step(const std::vector<float>& latent,
-                                    const std::vector<float>& t_emb,
-                                    const std::vector<float>& context);
-  std::vector<float> diffusion_process(
-      const std::vector<float>& encoded_text,
-      const std::vector<float>& unconditional_encoded_text, int num_steps,
-      int seed);
+
+  // Writes the encoding of the prompt to backend_data_->context, reusing a
+  // cached encoding if the prompt cache is enabled.
+  bool encode_prompt_cached(const std::vector<int>& prompt);
+  // Runs one UNet branch on the latent held in the latent input tensor.
+  // Switches the context input to context first, if given.
+  void diffusion_step(TfLiteInterpreter* interpreter,
+                      const std::vector<float>& t_emb,
+                      float* context = nullptr);
+  // Runs both classifier-free guidance branches with a batch 2 UNet.
+  void diffusion_step_batched(const std::vector<float>& t_emb);
+  // Leaves the final latent in the latent input tensor of the UNet.
+  void diffusion_process(int seed);
   int get_tensor_index_by_name(TfLiteInterpreter* interpreter,
                                const std::string& name, bool is_input);
-  std::vector<float> decode_image(const std::vector<float>& latent);
+  void decode_image();
 
   // Utility methods
-  std::vector<float> run_inference(TfLiteInterpreter* interpreter,
-                                   const std::vector<int>& encoded);
-  std::vector<float> run_inference(TfLiteInterpreter* interpreter,
-                                   const std::vector<float>& input);
+  void run_inference(TfLiteInterpreter* interpreter,
+                     const std::vector<int>& encoded);
   std::vector<float> get_timestep_embedding(int timestep, int dim = 320,
                                             float max_period = 10000.0f);
 
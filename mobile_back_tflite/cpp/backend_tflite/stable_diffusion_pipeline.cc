@@ -1,15 +1,20 @@
 #include "stable_diffusion_pipeline.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <new>
 #include <random>
 #include <valarray>
 
 #include "embedding_utils.h"
 #include "flutter/cpp/c/backend_c.h"
 #include "flutter/cpp/utils.h"
+#include "sd_utils.h"
 #include "stable_diffusion_invoker.h"
 #include "tensorflow/lite/c/c_api.h"
+#include "tensorflow/lite/c/c_api_experimental.h"
 #include "tensorflow/lite/c/common.h"
 #include "thread_pool.h"
 #include "utils.h"
@@ -40,6 +45,17 @@ inline mlperf_data_t::Type TfType2Type(TfLiteType type) {
   }
 }
 
+// Alignment TFLite requires for custom allocations.
+static constexpr size_t kTensorAlignment = 64;
+
+// Width of the sinusoidal timestep projection, which a UNet takes when it
+// includes the time embedding layers.
+static constexpr int kTimestepProjectionDim = 320;
+
+// Special tokens of the CLIP tokenizer.
+static constexpr int kStartOfTextToken = 49406;
+static constexpr int kEndOfTextToken = 49407;
+
 // Add definition for TFLiteNumElements
 size_t TFLiteNumElements(const TfLiteTensor* tensor) {
   size_t result = 1;
@@ -120,7 +136,55 @@ mlperf_backend_ptr_t StableDiffusionPipeline::backend_create(
     return nullptr;
   }
 
-  if (!EmbeddingManager::getInstance().load_timestep_embeddings(
+  // The CLIP tokenizer pads with the end of text token.
+  size_t max_tokens = TFLiteNumElements(TfLiteInterpreterGetInputTensor(
+      backend_data->text_encoder_interpreter, 0));
+  backend_data->unconditional_tokens.assign(max_tokens, kEndOfTextToken);
+  backend_data->unconditional_tokens[0] = kStartOfTextToken;
+
+  // The latent input has the shape [Batch, 64, 64, 4].
+  backend_data->batched_cfg =
+      TfLiteTensorDim(
+          TfLiteInterpreterGetInputTensor(backend_data->sd_interpreter, 0),
+          0) == 2;
+  if (!backend_data->batched_cfg &&
+      mlperf::mobile::GetConfigValue(configs, "stable_diffusion_concurrent_cfg",
+                                     0) != 0) {
+    // The interpreters share the model weights, only the activations are
+    // allocated twice.
+    backend_data->sd_unconditional_interpreter =
+        create_interpreter(backend_data->sd_model);
+    if (!backend_data->sd_unconditional_interpreter) {
+      backend_delete(backend_data);
+      return nullptr;
+    }
+  }
+
+  // Chain the interpreters, then encode the unconditional prompt into its
+  // resident context.
+  if (!bind_tensors(backend_data) ||
+      !StableDiffusionInvoker(backend_data)
+           .encode_prompt(backend_data->unconditional_tokens,
+                          backend_data->unconditional_context)) {
+    backend_delete(backend_data);
+    return nullptr;
+  }
+
+  int prompt_cache_size = mlperf::mobile::GetConfigValue(
+      configs, "stable_diffusion_prompt_cache_size", 0);
+  if (prompt_cache_size > 0) {
+    LOG(WARNING) << "Stable Diffusion prompt cache is enabled, the results "
+                    "are NOT valid for submission";
+    backend_data->max_cached_encodings = prompt_cache_size;
+  }
+
+  // Workers for the element-wise latent updates between UNet invocations.
+  unsigned int num_threads = std::min(std::thread::hardware_concurrency(), 4u);
+  backend_data->executer = std::unique_ptr<Threadpool>(
+      new Threadpool(num_threads > 0 ? num_threads - 1 : 0));
+
+  if (!timestep_embeddings_name.empty() &&
+      !EmbeddingManager::getInstance().load_timestep_embeddings(
           ts_embedding_path)) {
     LOG(ERROR) << "Failed to load timestep embeddings from "
                << ts_embedding_path;
@@ -128,9 +192,140 @@ mlperf_backend_ptr_t StableDiffusionPipeline::backend_create(
     return nullptr;
   }
 
+  backend_data->scheduler =
+      Scheduler::Create(mlperf::mobile::GetConfigValue(
+                            configs, "stable_diffusion_scheduler",
+                            std::string("ddim")),
+                        backend_data->num_steps);
+  backend_data->guidance_scale = mlperf::mobile::GetConfigValue(
+      configs, "stable_diffusion_guidance_scale", 7.5f);
+  if (!backend_data->scheduler || !prepare_timestep_embeddings(backend_data)) {
+    backend_delete(backend_data);
+    return nullptr;
+  }
+
   return backend_data;
 }
 
+bool StableDiffusionPipeline::bind_tensor(TfLiteInterpreter* interpreter,
+                                          int tensor_index, void* data,
+                                          size_t bytes) {
+  TfLiteCustomAllocation allocation = {data, bytes};
+  return TfLiteInterpreterSetCustomAllocationForTensor(
+             interpreter, tensor_index, &allocation,
+             kTfLiteCustomAllocationFlagsNone) == kTfLiteOk;
+}
+
+bool StableDiffusionPipeline::bind_tensors(SDBackendData* backend_data) {
+  TfLiteInterpreter* encoder = backend_data->text_encoder_interpreter;
+  TfLiteInterpreter* unet = backend_data->sd_interpreter;
+  TfLiteInterpreter* unconditional_unet =
+      backend_data->sd_unconditional_interpreter;
+  TfLiteInterpreter* decoder = backend_data->decoder_interpreter;
+
+  size_t bytes =
+      TfLiteTensorByteSize(TfLiteInterpreterGetOutputTensor(encoder, 0));
+  size_t context_input_bytes =
+      TfLiteTensorByteSize(TfLiteInterpreterGetInputTensor(unet, 1));
+  backend_data->context_bytes = bytes;
+  if (context_input_bytes != (backend_data->batched_cfg ? 2 : 1) * bytes) {
+    LOG(ERROR) << "The text encoder output does not match the context input";
+    return false;
+  }
+
+  float* unet_context = reinterpret_cast<float*>(
+      TfLiteTensorData(TfLiteInterpreterGetInputTensor(unet, 1)));
+  if (backend_data->batched_cfg) {
+    backend_data->unconditional_context = unet_context;
+    backend_data->context = unet_context + bytes / sizeof(float);
+  } else if (unconditional_unet) {
+    backend_data->unconditional_context =
+        reinterpret_cast<float*>(TfLiteTensorData(
+            TfLiteInterpreterGetInputTensor(unconditional_unet, 1)));
+    backend_data->context = unet_context;
+  } else {
+    for (int i = 0; i < 2; ++i) {
+      backend_data->context_storage.push_back(
+          ::operator new(bytes, std::align_val_t(kTensorAlignment)));
+    }
+    backend_data->unconditional_context =
+        static_cast<float*>(backend_data->context_storage[0]);
+    backend_data->context =
+        static_cast<float*>(backend_data->context_storage[1]);
+    if (!bind_tensor(unet, TfLiteInterpreterGetInputTensorIndex(unet, 1),
+                     backend_data->context, bytes) ||
+        TfLiteInterpreterAllocateTensors(unet) != kTfLiteOk) {
+      LOG(ERROR) << "Failed to bind the diffusion model context";
+      return false;
+    }
+  }
+  // Batch 2 rows start at a multiple of the alignment only if the row size is.
+  if (reinterpret_cast<uintptr_t>(backend_data->context) % kTensorAlignment) {
+    LOG(ERROR) << "The context rows are not aligned for the text encoder";
+    return false;
+  }
+
+  // The text encoder writes the prompt encoding straight into the context.
+  if (!bind_tensor(encoder, TfLiteInterpreterGetOutputTensorIndex(encoder, 0),
+                   backend_data->context, bytes) ||
+      TfLiteInterpreterAllocateTensors(encoder) != kTfLiteOk) {
+    LOG(ERROR) << "Failed to bind the text encoder output";
+    return false;
+  }
+
+  // The decoder reads the final latent from the first row of the UNet latent
+  // input. The UNet is not reallocated after this.
+  const TfLiteTensor* latent_input = TfLiteInterpreterGetInputTensor(unet, 0);
+  size_t latent_bytes =
+      TfLiteTensorByteSize(TfLiteInterpreterGetInputTensor(decoder, 0));
+  if (latent_bytes * (backend_data->batched_cfg ? 2 : 1) !=
+          TfLiteTensorByteSize(latent_input) ||
+      !bind_tensor(decoder, TfLiteInterpreterGetInputTensorIndex(decoder, 0),
+                   TfLiteTensorData(latent_input), latent_bytes) ||
+      TfLiteInterpreterAllocateTensors(decoder) != kTfLiteOk) {
+    LOG(ERROR) << "Failed to bind the decoder input";
+    return false;
+  }
+  return true;
+}
+
+bool StableDiffusionPipeline::prepare_timestep_embeddings(
+    SDBackendData* backend_data) {
+  auto& embedding_manager = EmbeddingManager::getInstance();
+  Scheduler* scheduler = backend_data->scheduler.get();
+  int num_steps = scheduler->num_steps();
+  const TfLiteTensor* t_emb_input =
+      TfLiteInterpreterGetInputTensor(backend_data->sd_interpreter, 2);
+  int dim = TfLiteTensorDim(t_emb_input, TfLiteTensorNumDims(t_emb_input) - 1);
+
+  // Prefer the precomputed embeddings, which also fix the timesteps.
+  auto table_timesteps = embedding_manager.get_timesteps(num_steps);
+  if (!table_timesteps.empty() && scheduler->accepts_timesteps()) {
+    scheduler->set_timesteps(table_timesteps);
+  }
+  bool use_table = !table_timesteps.empty() &&
+                   table_timesteps == scheduler->timesteps() &&
+                   embedding_manager.get_timestep_embedding(0, num_steps)
+                           .size() == static_cast<size_t>(dim);
+
+  backend_data->timestep_embeddings.clear();
+  for (int i = 0; i < num_steps; ++i) {
+    if (use_table) {
+      backend_data->timestep_embeddings.push_back(
+          embedding_manager.get_timestep_embedding(i, num_steps));
+    } else if (dim == kTimestepProjectionDim) {
+      backend_data->timestep_embeddings.push_back(
+          get_timestep_embedding(scheduler->timesteps()[i], 1, dim));
+    } else {
+      LOG(ERROR) << "No timestep embeddings for " << num_steps
+                 << " steps, and the UNet does not take the "
+                 << kTimestepProjectionDim << " wide timestep projection";
+      return false;
+    }
+  }
+  return true;
+}
+
 TfLiteInterpreter* StableDiffusionPipeline::create_interpreter(
     TfLiteModel* model) {
   TfLiteInterpreterOptions* options = TfLiteInterpreterOptionsCreate();
@@ -166,6 +361,13 @@ const char* StableDiffusionPipeline::backend_name(
 void StableDiffusionPipeline::backend_delete(mlperf_backend_ptr_t backend_ptr) {
   SDBackendData* backend_data = static_cast<SDBackendData*>(backend_ptr);
   if (backend_data) {
+    TfLiteInterpreterDelete(backend_data->text_encoder_interpreter);
+    TfLiteInterpreterDelete(backend_data->sd_interpreter);
+    TfLiteInterpreterDelete(backend_data->sd_unconditional_interpreter);
+    TfLiteInterpreterDelete(backend_data->decoder_interpreter);
+    for (void* storage : backend_data->context_storage) {
+      ::operator delete(storage, std::align_val_t(kTensorAlignment));
+    }
     TfLiteModelDelete(backend_data->text_encoder_model);
     TfLiteModelDelete(backend_data->sd_model);
     TfLiteModelDelete(backend_data->decoder_model);
@@ -177,9 +379,8 @@ void StableDiffusionPipeline::backend_delete(mlperf_backend_ptr_t backend_ptr) {
 mlperf_status_t StableDiffusionPipeline::backend_issue_query(
     mlperf_backend_ptr_t backend_ptr, ft_callback callback, void* context) {
   SDBackendData* backend_data = (SDBackendData*)backend_ptr;
-  StableDiffusionInvoker* invoker = new StableDiffusionInvoker(backend_data);
-  backend_data->output = invoker->invoke();
-  return MLPERF_SUCCESS;
+  StableDiffusionInvoker invoker(backend_data);
+  return invoker.invoke() ? MLPERF_SUCCESS : MLPERF_FAILURE;
 }
 
 mlperf_status_t StableDiffusionPipeline::backend_flush_queries(
@@ -238,12 +439,11 @@ mlperf_status_t StableDiffusionPipeline::backend_set_input(
     ++token_count;
   }
 
-  std::vector<int> unconditioned_tokens(77, 49407);
-  unconditioned_tokens[0] = 49406;
-
+  // Pad to the full input length, so the encoding does not depend on the
+  // tokens of a previous prompt and equal prompts share a cache entry.
   backend_data->input_prompt_tokens.assign(tokens, tokens + token_count);
-  backend_data->unconditional_tokens.assign(unconditioned_tokens.begin(),
-                                            unconditioned_tokens.end());
+  backend_data->input_prompt_tokens.resize(
+      backend_data->unconditional_tokens.size(), kEndOfTextToken);
 
   return MLPERF_SUCCESS;
 }
@@ -290,7 +490,8 @@ mlperf_status_t StableDiffusionPipeline::backend_get_output(
   SDBackendData* backend_data = static_cast<SDBackendData*>(backend_ptr);
 
   if (i == 0) {
-    *data = backend_data->output.data();
+    *data = TfLiteTensorData(
+        TfLiteInterpreterGetOutputTensor(backend_data->decoder_interpreter, 0));
     return MLPERF_SUCCESS;
   }
 
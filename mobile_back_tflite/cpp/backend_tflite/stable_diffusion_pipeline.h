@@ -13,10 +13,14 @@ limitations under the License.
 #ifndef TFLITE_STABLE_DIFFUSION_PIPELINE_H_
 #define TFLITE_STABLE_DIFFUSION_PIPELINE_H_
 
+#include <list>
+#include <memory>
+#include <utility>
 #include <vector>
 
 #include "flutter/cpp/c/type.h"
 #include "pipeline.h"
+#include "sd_scheduler.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/lite/c/c_api.h"
 #include "thread_pool.h"
@@ -34,13 +38,41 @@ struct SDBackendData {
   TfLiteInterpreter *sd_interpreter{nullptr};
   TfLiteInterpreter *decoder_interpreter{nullptr};
 
+  // Classifier-free guidance runs the UNet for an unconditional and a
+  // conditional branch. A UNet exported with batch 2 runs both in a single
+  // invocation. Otherwise, with the stable_diffusion_concurrent_cfg setting,
+  // a second interpreter runs the unconditional branch concurrently.
+  bool batched_cfg{false};
+  TfLiteInterpreter *sd_unconditional_interpreter{nullptr};
+
   std::vector<int> input_prompt_tokens;
   std::vector<int> unconditional_tokens;
 
+  // Where the UNet reads the unconditional and the conditional context: the
+  // rows of a batch 2 UNet, the inputs of the two interpreters, or two backend
+  // owned buffers the single interpreter switches between. The text encoder
+  // writes into them directly. The unconditional tokens never change, so
+  // their encoding is written once in backend_create and stays resident.
+  float *unconditional_context{nullptr};
+  float *context{nullptr};
+  size_t context_bytes{0};
+  std::vector<void *> context_storage;
+  // Recently used prompt encodings keyed by their tokens, most recent first.
+  // Only kept with the stable_diffusion_prompt_cache_size setting, since
+  // reusing the results of earlier queries is not valid for submission.
+  size_t max_cached_encodings{0};
+  std::list<std::pair<std::vector<int>, std::vector<float>>> encoding_cache;
+
   int num_steps{20};
   int seed{633994880};
 
-  std::vector<float> output;
+  // Selected with the stable_diffusion_scheduler and
+  // stable_diffusion_guidance_scale settings.
+  std::unique_ptr<Scheduler> scheduler;
+  float guidance_scale{7.5f};
+  // The UNet timestep input for each of scheduler->timesteps().
+  std::vector<std::vector<float>> timestep_embeddings;
+
   std::unique_ptr<Threadpool> executer;
 };
 
@@ -99,8 +131,19 @@ class StableDiffusionPipeline : public Pipeline {
 
   void backend_release_buffer(void *p) override;
 
+  // Points a tensor to external memory, which must be 64 byte aligned. Only
+  // the first binding of a tensor needs AllocateTensors() afterwards.
+  static bool bind_tensor(TfLiteInterpreter *interpreter, int tensor_index,
+                          void *data, size_t bytes);
+
  private:
   TfLiteInterpreter *create_interpreter(TfLiteModel *model);
+  // Chains the interpreters through custom allocations, see SDBackendData.
+  // The decoder input is bound to the latent input of the UNet.
+  bool bind_tensors(SDBackendData *backend_data);
+  // Fills timestep_embeddings for the scheduler, from the embedding file if it
+  // has the step count and from get_timestep_embedding() otherwise.
+  bool prepare_timestep_embeddings(SDBackendData *backend_data);
 };
 
 #endif  // TFLITE_STABLE_DIFFUSION_PIPELINE_H_
@@ -276,6 +276,30 @@ void mlperf_backend_convert_outputs(mlperf_backend_ptr_t backend_ptr, int bytes,
                                            data);
 }
 
+mlperf_status_t mlperf_backend_bind_input(mlperf_backend_ptr_t backend_ptr,
+                                          int32_t batch_index, int32_t i,
+                                          void *data) {
+  return pipeline->backend_bind_input(backend_ptr, batch_index, i, data);
+}
+
+int32_t mlperf_backend_get_token_timestamps(mlperf_backend_ptr_t backend_ptr,
+                                            int64_t *timestamps_ns,
+                                            int32_t capacity) {
+  return pipeline->backend_get_token_timestamps(backend_ptr, timestamps_ns,
+                                                capacity);
+}
+
+mlperf_status_t mlperf_backend_get_draft_token_counts(
+    mlperf_backend_ptr_t backend_ptr, int64_t *proposed, int64_t *accepted) {
+  return pipeline->backend_get_draft_token_counts(backend_ptr, proposed,
+                                                  accepted);
+}
+
+mlperf_status_t mlperf_backend_set_token_callback(
+    mlperf_backend_ptr_t backend_ptr, token_callback callback, void *context) {
+  return pipeline->backend_set_token_callback(backend_ptr, callback, context);
+}
+
 void *mlperf_backend_get_buffer(size_t n) {
   return pipeline->backend_get_buffer(n);
 }
@@ -12,99 +12,192 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
-/* Copyright (c) 2012 Jakob Progsch, Václav Zeman
-
-This software is provided 'as-is', without any express or implied
-warranty. In no event will the authors be held liable for any damages
-arising from the use of this software.
-
-Permission is granted to anyone to use this software for any purpose,
-including commercial applications, and to alter it and redistribute it
-freely, subject to the following restrictions:
-
-  1. The origin of this software must not be misrepresented; you must not
-  claim that you wrote the original software. If you use this software
-  in a product, an acknowledgment in the product documentation would be
-  appreciated but is not required.
-
-  2. Altered source versions must be plainly marked as such, and must not be
-  misrepresented as being the original software.
-
-  3. This notice may not be removed or altered from any source
-  distribution.
-==============================================================================*/
-// reference:
-// https://github.com/progschj/ThreadPool
-
 #ifndef THREAD_POOL_H_
 #define THREAD_POOL_H_
 
+#include <array>
 #include <atomic>
 #include <condition_variable>
-#include <functional>
-#include <future>
-#include <iostream>
-#include <queue>
-#include <stdexcept>
+#include <cstddef>
+#include <memory>
+#include <mutex>
 #include <thread>
+#include <vector>
 
+// Threadpool runs fork-join loops on a fixed set of workers. Every worker owns
+// a bounded deque of tasks: it takes work from the back of its own deque and
+// steals from the front of the others when it runs out. Tasks are plain
+// structs stored in place, so dispatching a loop does not allocate.
 class Threadpool {
- private:
-  std::vector<std::thread> pool;
-  std::queue<std::function<void()>> tasks;
-  // synchronization variable
-  std::mutex m_lock;
-  std::condition_variable cond_var;
-  std::atomic<bool> available;
-
  public:
-  inline Threadpool(size_t thread_num) : available(true) {
+  explicit Threadpool(size_t thread_num) {
     for (size_t i = 0; i < thread_num; i++) {
-      pool.emplace_back([this] {
-        while (available.load()) {
-          std::function<void()> picked_task;
-          // consumer in critical section
-          {
-            std::unique_lock<std::mutex> lock(this->m_lock);
-            auto wait_until = [this]() -> bool {
-              return !this->available.load() || !this->tasks.empty();
-            };
-            this->cond_var.wait(lock, wait_until);
-            if (!this->available && this->tasks.empty()) return;
-            picked_task = std::move(this->tasks.front());
-            this->tasks.pop();
-          }
-          // invoke picked task
-          picked_task();
-        }
-      });
+      queues_.emplace_back(new WorkerQueue());
+    }
+    for (size_t i = 0; i < thread_num; i++) {
+      workers_.emplace_back([this, i] { WorkerLoop(i); });
     }
   }
+
   ~Threadpool() {
-    available.store(false);
-    cond_var.notify_all();
-    for (auto& worker : pool) {
+    {
+      std::lock_guard<std::mutex> lock(sleep_lock_);
+      available_ = false;
+    }
+    sleep_cv_.notify_all();
+    for (auto& worker : workers_) {
       if (worker.joinable()) worker.join();
     }
   }
 
-  template <typename Fn, typename... Args>
-  auto submit(Fn&& fn, Args&&... args) -> std::future<decltype(fn(args...))> {
-    if (!available.load()) {
-      std::cerr << "don't accept commit after stop." << std::endl;
-      assert(false);
+  size_t size() const { return workers_.size(); }
+
+  // Calls fn(i) for every i in [0, count) and returns when all calls have
+  // finished. The calling thread runs index 0 itself and then helps with the
+  // remaining tasks instead of blocking.
+  template <typename Fn>
+  void parallel_for(size_t count, const Fn& fn) {
+    if (count == 0) return;
+    if (queues_.empty() || count == 1) {
+      for (size_t i = 0; i < count; i++) fn(i);
+      return;
     }
-    using FnReturnType = decltype(fn(args...));
-    auto enq_task = std::make_shared<std::packaged_task<FnReturnType()>>(
-        std::bind(std::forward<Fn>(fn), std::forward<Args>(args)...));
-    std::future<FnReturnType> ret = enq_task->get_future();
-    // producer in critical section
-    {
-      std::lock_guard<std::mutex> lock(m_lock);
-      tasks.emplace([enq_task]() { (*enq_task)(); });
+
+    ForkJoin<Fn> state(&fn, count - 1);
+    size_t pushed = 0;
+    for (size_t i = 1; i < count; i++) {
+      Task task{&RunForkJoin<Fn>, &state, i};
+      size_t queue = next_queue_.fetch_add(1) % queues_.size();
+      // Count the task before it becomes visible, so that a worker taking it
+      // right away never decrements queued_ below zero.
+      queued_++;
+      if (queues_[queue]->Push(task)) {
+        pushed++;
+      } else {
+        // The deque is full, run the task here.
+        queued_--;
+        task.run(task.ctx, task.index);
+      }
+    }
+    if (pushed > 0) {
+      // Workers check queued_ under sleep_lock_ before they wait, so taking
+      // it here makes sure none of them misses the notification.
+      { std::lock_guard<std::mutex> lock(sleep_lock_); }
+      sleep_cv_.notify_all();
+    }
+
+    fn(0);
+
+    // Help with queued tasks until all tasks of this loop have finished.
+    while (!state.Done()) {
+      if (!TryRunOne(0)) {
+        state.Wait();
+        break;
+      }
+    }
+  }
+
+ private:
+  static constexpr size_t kQueueCapacity = 64;
+
+  struct Task {
+    void (*run)(void* ctx, size_t index);
+    void* ctx;
+    size_t index;
+  };
+
+  // Bounded deque of tasks. The owner uses the back and thieves the front.
+  struct WorkerQueue {
+    std::mutex lock;
+    std::array<Task, kQueueCapacity> ring;
+    size_t head = 0;
+    size_t tail = 0;
+
+    bool Push(const Task& task) {
+      std::lock_guard<std::mutex> guard(lock);
+      if (tail - head == kQueueCapacity) return false;
+      ring[tail++ % kQueueCapacity] = task;
+      return true;
+    }
+
+    bool PopBack(Task* task) {
+      std::lock_guard<std::mutex> guard(lock);
+      if (tail == head) return false;
+      *task = ring[--tail % kQueueCapacity];
+      return true;
+    }
+
+    bool StealFront(Task* task) {
+      std::lock_guard<std::mutex> guard(lock);
+      if (tail == head) return false;
+      *task = ring[head++ % kQueueCapacity];
+      return true;
+    }
+  };
+
+  // State of one parallel_for call. It lives on the stack of the caller.
+  template <typename Fn>
+  struct ForkJoin {
+    ForkJoin(const Fn* fn, size_t remaining) : fn(fn), remaining(remaining) {}
+
+    bool Done() {
+      std::lock_guard<std::mutex> guard(lock);
+      return remaining == 0;
     }
-    cond_var.notify_one();
-    return ret;
+
+    void Wait() {
+      std::unique_lock<std::mutex> guard(lock);
+      done.wait(guard, [this] { return remaining == 0; });
+    }
+
+    const Fn* fn;
+    size_t remaining;
+    std::mutex lock;
+    std::condition_variable done;
+  };
+
+  template <typename Fn>
+  static void RunForkJoin(void* ctx, size_t index) {
+    ForkJoin<Fn>* state = static_cast<ForkJoin<Fn>*>(ctx);
+    (*state->fn)(index);
+    // The caller may return as soon as remaining drops to zero, so state must
+    // not be touched after the lock is released.
+    std::lock_guard<std::mutex> guard(state->lock);
+    if (--state->remaining == 0) state->done.notify_all();
   }
+
+  // Runs one queued task, looking at the deque of worker first and stealing
+  // from the others. Returns false if there was nothing to run.
+  bool TryRunOne(size_t worker) {
+    Task task;
+    for (size_t k = 0; k < queues_.size(); k++) {
+      WorkerQueue* queue = queues_[(worker + k) % queues_.size()].get();
+      if (k == 0 ? queue->PopBack(&task) : queue->StealFront(&task)) {
+        queued_--;
+        task.run(task.ctx, task.index);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void WorkerLoop(size_t worker) {
+    while (true) {
+      if (TryRunOne(worker)) continue;
+      std::unique_lock<std::mutex> lock(sleep_lock_);
+      sleep_cv_.wait(lock, [this] { return !available_ || queued_ > 0; });
+      if (!available_ && queued_ == 0) return;
+    }
+  }
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> next_queue_{0};
+  // Number of tasks in all deques. It is incremented before a push and
+  // decremented after a pop, so it never drops below the actual number.
+  std::atomic<size_t> queued_{0};
+  std::mutex sleep_lock_;
+  std::condition_variable sleep_cv_;
+  bool available_ = true;
 };
 #endif  // THREAD_POOL_H_
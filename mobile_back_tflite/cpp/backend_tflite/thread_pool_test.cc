@@ -0,0 +1,89 @@
+/* Copyright 2025 The MLPerf Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "thread_pool.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+using ::testing::Each;
+
+TEST(Threadpool, VisitsEveryIndexOnce) {
+  Threadpool pool(4);
+  std::vector<std::atomic<int>> visits(100);
+  pool.parallel_for(visits.size(), [&visits](size_t i) { visits[i]++; });
+  for (const auto& count : visits) EXPECT_EQ(count.load(), 1);
+}
+
+TEST(Threadpool, RunsTasksInlineWhenDequesAreFull) {
+  // Far more tasks than two deques hold, so most of them run on the caller.
+  Threadpool pool(2);
+  std::vector<std::atomic<int>> visits(1000);
+  for (int round = 0; round < 20; round++) {
+    pool.parallel_for(visits.size(), [&visits](size_t i) { visits[i]++; });
+  }
+  for (const auto& count : visits) EXPECT_EQ(count.load(), 20);
+}
+
+TEST(Threadpool, RunsNestedLoops) {
+  Threadpool pool(3);
+  std::vector<std::atomic<int>> visits(16 * 16);
+  pool.parallel_for(16, [&pool, &visits](size_t i) {
+    pool.parallel_for(16, [&visits, i](size_t j) { visits[i * 16 + j]++; });
+  });
+  for (const auto& count : visits) EXPECT_EQ(count.load(), 1);
+}
+
+TEST(Threadpool, RunsConcurrentLoops) {
+  Threadpool pool(4);
+  constexpr int kCallers = 4;
+  std::vector<std::vector<int>> visits(kCallers, std::vector<int>(200, 0));
+  std::vector<std::thread> callers;
+  for (int c = 0; c < kCallers; c++) {
+    callers.emplace_back([&pool, &visits, c] {
+      for (int round = 0; round < 50; round++) {
+        pool.parallel_for(visits[c].size(),
+                          [&visits, c](size_t i) { visits[c][i]++; });
+      }
+    });
+  }
+  for (auto& caller : callers) caller.join();
+  for (const auto& caller_visits : visits) {
+    EXPECT_THAT(caller_visits, Each(50));
+  }
+}
+
+TEST(Threadpool, ShutsDownAfterLoad) {
+  // The destructor waits for queued_ to drop to zero, so an unbalanced
+  // counter would hang here.
+  for (int round = 0; round < 20; round++) {
+    Threadpool pool(3);
+    std::atomic<int> sum{0};
+    pool.parallel_for(500, [&sum](size_t i) { sum += static_cast<int>(i); });
+    EXPECT_EQ(sum.load(), 500 * 499 / 2);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}